@@ -0,0 +1,751 @@
+/*
+*	Microbenchmarks for the game core. Each benchmark is named on the
+*	command line (all of them run if none is) and prints what it did and
+*	how fast.
+*
+*	Build with -O2 so the numbers mean something:
+*		g++ -std=c++20 -O2 -pthread bench.cpp -o bench
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+//semctl(2): the caller defines this
+union semun { int val; struct semid_ds *buf; unsigned short *array; };
+
+#include "semaphore.h"
+#include "futexsem.h"
+#include "board.h"
+#include "outcome.h"
+#include "solver.h"
+#include "mnk.h"
+#include "winners.h"
+#include "mcts.h"
+#include "ultimate.h"
+#include "playerstore.h"
+
+#define BENCH_BOARDS 4096      //distinct positions each benchmark cycles over
+#define BENCH_ROUNDS 2000      //passes over them
+#define BENCH_PLAYERS 1000000  //records in the player store
+#define BENCH_RECORDS "/tmp/ooipc_bench_records" //and the file it maps
+#define BENCH_SEM_KEY 32590    //and the next key, for the semaphores compared
+#define BENCH_SEM_ROUNDS 200000 //critical sections, split over the processes
+
+//the server's player record
+typedef struct BenchPlayerData {
+   int playerID;
+   char firstName[10];
+   char lastName[10];
+   int wins;
+   int losses;
+   int ties;
+} BenchPlayer;
+
+typedef struct BenchData {
+   const char *name;
+   void (*run)();
+} Bench;
+
+void bench_outcome();
+void bench_solver();
+void bench_symmetry();
+void bench_mnk();
+void bench_winners();
+void bench_mcts();
+void bench_ultimate();
+void bench_players();
+void bench_semaphore();
+template<class S> double time_semaphore(S *sem, int procs, long *counter);
+int random_ultimate_move(UltimateBoard *b);
+double time_winners(CheckWinners check, const Board *boards, Outcome *out, int n, int rounds);
+int gomoku_scan(Gomoku *b, int r, int c, char symbol);
+char checkWinner(char board[][3]);
+int make_boards(Board *boards, int n, unsigned seed);
+double now_seconds();
+
+Bench benches[] = {
+   {"outcome", bench_outcome},
+   {"solver", bench_solver},
+   {"symmetry", bench_symmetry},
+   {"mnk", bench_mnk},
+   {"winners", bench_winners},
+   {"mcts", bench_mcts},
+   {"ultimate", bench_ultimate},
+   {"players", bench_players},
+   {"semaphore", bench_semaphore},
+};
+
+int main(int argc, char *argv[]) {
+	int i, j;
+	int count = sizeof(benches)/sizeof(benches[0]);
+
+	for(i = 0; i < count; i = i + 1) {
+		if(argc > 1) {
+			for(j = 1; j < argc; j = j + 1) {
+				if(strcmp(argv[j], benches[i].name) == 0) {
+					break;
+				}
+			}
+			if(j == argc) {
+				continue;
+			}
+		}
+		printf("%s:\n", benches[i].name);
+		benches[i].run();
+	}
+
+	return 0;
+}
+
+/*
+*	Game over checks: checkWinner() as the forking server used to run it,
+*	on a char[3][3] board, against the line loop over the bitboards and
+*	the single OUTCOMES load that replaced both.
+*/
+void bench_outcome() {
+	static Board boards[BENCH_BOARDS];
+	static char grids[BENCH_BOARDS][3][3];
+	long sum, checks = (long)BENCH_BOARDS*BENCH_ROUNDS;
+	double start, loop_s, mask_s, table_s;
+	int i, r, sq;
+
+	make_boards(boards, BENCH_BOARDS, 1);
+	for(i = 0; i < BENCH_BOARDS; i = i + 1) {
+		for(sq = 0; sq < 9; sq = sq + 1) {
+			grids[i][sq/3][sq%3] = boards[i].at(sq);
+		}
+	}
+
+	sum = 0;
+	start = now_seconds();
+	for(r = 0; r < BENCH_ROUNDS; r = r + 1) {
+		for(i = 0; i < BENCH_BOARDS; i = i + 1) {
+			sum += checkWinner(grids[i]);
+		}
+		__asm__ volatile("" : : "r"(sum) : "memory");
+	}
+	loop_s = now_seconds() - start;
+	printf("  checkWinner   %6.2f ns/board  (%ld)\n", loop_s*1e9/checks, sum);
+
+	sum = 0;
+	start = now_seconds();
+	for(r = 0; r < BENCH_ROUNDS; r = r + 1) {
+		for(i = 0; i < BENCH_BOARDS; i = i + 1) {
+			sum += boards[i].winner();
+		}
+		__asm__ volatile("" : : "r"(sum) : "memory");
+	}
+	mask_s = now_seconds() - start;
+	printf("  Board::winner %6.2f ns/board  (%ld)\n", mask_s*1e9/checks, sum);
+
+	sum = 0;
+	start = now_seconds();
+	for(r = 0; r < BENCH_ROUNDS; r = r + 1) {
+		for(i = 0; i < BENCH_BOARDS; i = i + 1) {
+			sum += OUTCOMES.status(boards[i]);
+		}
+		__asm__ volatile("" : : "r"(sum) : "memory");
+	}
+	table_s = now_seconds() - start;
+	printf("  OUTCOMES      %6.2f ns/board  (%ld)\n", table_s*1e9/checks, sum);
+	printf("  table is %.1fx checkWinner, %.1fx Board::winner\n", loop_s/table_s, mask_s/table_s);
+}
+
+/*
+*	Perfect play: every position a game can reach, solved from a cold
+*	transposition table and again from a warm one as the bot seat sees it,
+*	with each score checked against the value OUTCOMES worked out.
+*/
+void bench_solver() {
+	static int positions[OutcomeTable::POSITIONS];
+	static Board boards[OutcomeTable::POSITIONS];
+	Solver *solver = new Solver();
+	Outcome value;
+	int n = 0, wrong = 0;
+	int i, v, sq, index;
+	long sum = 0, nodes = 0;
+	double start, cold_s, warm_s;
+
+	//every reachable position that is still in play
+	for(index = 0; index < OutcomeTable::POSITIONS; index = index + 1) {
+		if(!OUTCOMES.reachable(index) || OUTCOMES.status(index) != IN_PLAY) {
+			continue;
+		}
+		v = index;
+		for(sq = 0; sq < 9; sq = sq + 1) {
+			if(v % 3 != 0) {
+				boards[n].play(sq, v % 3 == 1 ? 'X' : 'O');
+			}
+			v = v / 3;
+		}
+		positions[n] = index;
+		n = n + 1;
+	}
+
+	start = now_seconds();
+	for(i = 0; i < n; i = i + 1) {
+		solver->clear();
+		v = solver->score(boards[i]);
+		sum += v;
+		nodes += solver->nodes;
+
+		value = OUTCOMES.value(positions[i]);
+		if((v > 0 && value != (Outcome)(OUTCOMES.to_move(positions[i]) == 'X' ? X_WINS : O_WINS)) ||
+		   (v < 0 && value != (Outcome)(OUTCOMES.to_move(positions[i]) == 'X' ? O_WINS : X_WINS)) ||
+		   (v == 0 && value != DRAW)) {
+			wrong = wrong + 1;
+		}
+	}
+	cold_s = now_seconds() - start;
+	printf("  cold   %8.0f positions/s, %ld nodes each  (%d positions, %d wrong)\n",
+	       n/cold_s, nodes/n, n, wrong);
+
+	solver->clear();
+	start = now_seconds();
+	solver->score(boards[0]);
+	printf("  empty board from cold  %.1f us, %ld nodes\n", (now_seconds() - start)*1e6, solver->nodes);
+
+	solver->clear();
+	for(i = 0; i < n; i = i + 1) {
+		solver->best_move(boards[i]);
+	}
+	solver->nodes = 0;
+	start = now_seconds();
+	for(v = 0; v < 100; v = v + 1) {
+		for(i = 0; i < n; i = i + 1) {
+			sum += solver->best_move(boards[i]);
+		}
+	}
+	warm_s = now_seconds() - start;
+	printf("  warm   %8.0f positions/s, %.2f us a move  (%ld)\n", n*100/warm_s, warm_s*1e6/(n*100), sum);
+
+	delete solver;
+}
+
+/*
+*	Canonical boards: how long canonical() takes and how far it shrinks the
+*	set of positions a game can reach, which is what a cache keyed on them
+*	has to hold.
+*/
+void bench_symmetry() {
+	static Board boards[BENCH_BOARDS];
+	static char seen[1 << 18];
+	long sum = 0, checks = (long)BENCH_BOARDS*BENCH_ROUNDS;
+	int reachable = 0, canonical = 0;
+	int i, r, t, v, sq;
+	double start, canon_s;
+	Board b, c;
+
+	for(i = 0; i < OutcomeTable::POSITIONS; i = i + 1) {
+		if(!OUTCOMES.reachable(i)) {
+			continue;
+		}
+		b.clear();
+		v = i;
+		for(sq = 0; sq < 9; sq = sq + 1) {
+			if(v % 3 != 0) {
+				b.play(sq, v % 3 == 1 ? 'X' : 'O');
+			}
+			v = v / 3;
+		}
+		c = b.canonical(&t);
+		reachable = reachable + 1;
+		if(!seen[c.x << 9 | c.o]) {
+			seen[c.x << 9 | c.o] = 1;
+			canonical = canonical + 1;
+		}
+	}
+	printf("  %d reachable positions, %d canonical (%.1fx fewer)\n", reachable, canonical,
+	       (double)reachable/canonical);
+
+	make_boards(boards, BENCH_BOARDS, 1);
+	start = now_seconds();
+	for(r = 0; r < BENCH_ROUNDS; r = r + 1) {
+		for(i = 0; i < BENCH_BOARDS; i = i + 1) {
+			c = boards[i].canonical(&t);
+			sum += c.x + t;
+		}
+		__asm__ volatile("" : : "r"(sum) : "memory");
+	}
+	canon_s = now_seconds() - start;
+	printf("  canonical() %6.2f ns/board  (%ld)\n", canon_s*1e9/checks, sum);
+}
+
+/*
+*	check_winners() over a large batch, on each path this CPU has, with
+*	every path checked against the table
+*/
+void bench_winners() {
+	static Board boards[1 << 16];
+	static Outcome expect[1 << 16];
+	static Outcome out[1 << 16];
+	int n = 1 << 16;
+	int rounds = 200;
+	int i, p, wrong;
+	struct { const char *name; CheckWinners check; int ok; } paths[] = {
+		{"scalar", check_winners_scalar, 1},
+#ifdef WINNERS_X86
+		{"sse2", check_winners_sse2, __builtin_cpu_supports("sse2")},
+		{"avx2", check_winners_avx2, __builtin_cpu_supports("avx2")},
+#endif
+		{"picked", check_winners, 1},
+	};
+
+	make_boards(boards, n, 2);
+	for(i = 0; i < n; i = i + 1) {
+		expect[i] = OUTCOMES.status(boards[i]);
+	}
+
+	for(p = 0; p < (int)(sizeof(paths)/sizeof(paths[0])); p = p + 1) {
+		if(!paths[p].ok) {
+			printf("  %-7s not supported by this CPU\n", paths[p].name);
+			continue;
+		}
+		//an odd count so the tail is checked too
+		memset(out, 0xff, sizeof(out));
+		paths[p].check(boards, n - 3, out);
+		wrong = 0;
+		for(i = 0; i < n - 3; i = i + 1) {
+			if(out[i] != expect[i]) {
+				wrong = wrong + 1;
+			}
+		}
+		printf("  %-7s %7.1f M boards/s  (%d wrong)\n", paths[p].name,
+		       (double)n*rounds/time_winners(paths[p].check, boards, out, n, rounds)/1e6, wrong);
+	}
+}
+
+double time_winners(CheckWinners check, const Board *boards, Outcome *out, int n, int rounds) {
+	double start = now_seconds();
+	int r;
+
+	for(r = 0; r < rounds; r = r + 1) {
+		check(boards, n, out);
+		__asm__ volatile("" : : "r"(out) : "memory");
+	}
+	return now_seconds() - start;
+}
+
+/*
+*	Gomoku, 15x15 with 5 to win: the cost of a move's win check with the
+*	vector check through the last move, against counting outwards from it
+*	one square at a time. Both replay the same random games.
+*/
+void bench_mnk() {
+	static char moves[64][Gomoku::SQUARES][2];
+	static int lengths[64];
+	Gomoku b;
+	long wins = 0, scans = 0, played = 0;
+	int g, i, r, c, rounds;
+	char symbol;
+	double start, simd_s, scan_s;
+
+	srand(1);
+	for(g = 0; g < 64; g = g + 1) {
+		b.clear();
+		symbol = 'X';
+		lengths[g] = 0;
+		while(!b.full()) {
+			r = rand() % Gomoku::ROWS;
+			c = rand() % Gomoku::COLS;
+			if(b.taken(r, c)) {
+				continue;
+			}
+			moves[g][lengths[g]][0] = r;
+			moves[g][lengths[g]][1] = c;
+			lengths[g] = lengths[g] + 1;
+			if(b.play(r, c, symbol)) {
+				break;
+			}
+			symbol = symbol == 'X' ? 'O' : 'X';
+		}
+	}
+
+	start = now_seconds();
+	for(rounds = 0; rounds < 200; rounds = rounds + 1) {
+		for(g = 0; g < 64; g = g + 1) {
+			b.clear();
+			for(i = 0; i < lengths[g]; i = i + 1) {
+				wins += b.play(moves[g][i][0], moves[g][i][1], i % 2 == 0 ? 'X' : 'O');
+			}
+			played += lengths[g];
+		}
+	}
+	simd_s = now_seconds() - start;
+
+	start = now_seconds();
+	for(rounds = 0; rounds < 200; rounds = rounds + 1) {
+		for(g = 0; g < 64; g = g + 1) {
+			b.clear();
+			for(i = 0; i < lengths[g]; i = i + 1) {
+				symbol = i % 2 == 0 ? 'X' : 'O';
+				b.play(moves[g][i][0], moves[g][i][1], symbol);
+				scans += gomoku_scan(&b, moves[g][i][0], moves[g][i][1], symbol);
+			}
+		}
+	}
+	scan_s = now_seconds() - start;
+
+	printf("  vector check  %6.2f ns/move  (%ld wins in %ld moves)\n", simd_s*1e9/played, wins, played);
+	printf("  square scan   %6.2f ns/move on top  (%ld wins)\n", (scan_s - simd_s)*1e9/played, scans);
+}
+
+/*
+*	Monte Carlo tree search: playouts a second on an empty Gomoku board for
+*	1, 2, 4... threads up to the number of cores, and how the tic-tac-toe
+*	moves it finds in a short search score against the solver's.
+*/
+void bench_mcts() {
+	static Board boards[BENCH_BOARDS];
+	Gomoku gomoku;
+	TicTacToe board;
+	Solver solver;
+	int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads, i, sq, wrong = 0, tried = 0;
+	double one = 0, rate;
+	char symbol;
+
+	for(threads = 1; threads <= ncpu; threads = threads < ncpu && threads*2 > ncpu ? ncpu : threads*2) {
+		Mcts<Gomoku> mcts(threads, 1 << 20);
+		mcts.search(gomoku, 'X', 200000);
+		rate = mcts.playouts()/0.2;
+		if(threads == 1) {
+			one = rate;
+		}
+		printf("  gomoku %2d threads  %9.0f playouts/s  (%.2fx)\n", threads, rate, rate/one);
+	}
+
+	Mcts<TicTacToe> mcts(ncpu, 1 << 20);
+	make_boards(boards, 200, 3);
+	for(i = 0; i < 200; i = i + 1) {
+		if(OUTCOMES.status(boards[i]) != IN_PLAY) {
+			continue;
+		}
+		board.clear();
+		for(sq = 0; sq < 9; sq = sq + 1) {
+			if(boards[i].at(sq) != 0) {
+				board.play(sq / 3, sq % 3, boards[i].at(sq));
+			}
+		}
+		symbol = boards[i].moves() % 2 == 0 ? 'X' : 'O';
+		sq = mcts.search(board, symbol, 20000);
+
+		//a move is wrong if it gives up a win or a draw the solver would keep
+		Board next = boards[i];
+		next.play(sq, symbol);
+		if(-solver.score(next) < 0 && solver.score(boards[i]) >= 0) {
+			wrong = wrong + 1;
+		} else if(-solver.score(next) <= 0 && solver.score(boards[i]) > 0) {
+			wrong = wrong + 1;
+		}
+		tried = tried + 1;
+	}
+	printf("  tictactoe 20 ms     %d of %d moves lose a result the solver keeps\n", wrong, tried);
+}
+
+/*
+*	Ultimate tic-tac-toe: what a move costs the grid to keep up to date, and
+*	what the bot spends on each move of games against random moves, which
+*	its budget should keep about the same from the first move to the last
+*/
+void bench_ultimate() {
+	UltimateBoard b;
+	UltimateBot bot;
+	long moves = 0, bot_moves = 0, nodes = 0, results[4] = {0};
+	int g, move;
+	double start, t, played_s, bot_s = 0, bot_max = 0;
+
+	srand(4);
+	start = now_seconds();
+	for(g = 0; g < 100000; g = g + 1) {
+		b.clear();
+		while(b.result == IN_PLAY) {
+			random_ultimate_move(&b);
+			moves = moves + 1;
+		}
+	}
+	played_s = now_seconds() - start;
+
+	for(g = 0; g < 20; g = g + 1) {
+		b.clear();
+		while(b.result == IN_PLAY) {
+			if((b.count % 2 == 0) == (g % 2 == 0)) {
+				t = now_seconds();
+				move = bot.best_move(b);
+				t = now_seconds() - t;
+				bot_s = bot_s + t;
+				if(t > bot_max) {
+					bot_max = t;
+				}
+				nodes = nodes + bot.nodes;
+				bot_moves = bot_moves + 1;
+				b.play(move / 9, move % 9, b.to_move());
+			} else {
+				random_ultimate_move(&b);
+			}
+		}
+		//count the bot's results as if it were always X
+		results[g % 2 == 0 || b.result == DRAW ? b.result : X_WINS + O_WINS - b.result]++;
+	}
+
+	printf("  play()     %6.1f ns/move, random games included\n", played_s*1e9/moves);
+	printf("  bot        %6.2f ms/move on average, %.2f ms at most, %ld positions a move\n",
+	       bot_s*1e3/bot_moves, bot_max*1e3, nodes/bot_moves);
+	printf("  bot against random moves: %ld won, %ld lost, %ld drawn\n", results[X_WINS], results[O_WINS],
+	       results[DRAW]);
+}
+
+/*
+*	The player store (playerstore.h) with a million records: adding them,
+*	looking ids up by the hash index, and the linear scan over the records
+*	it replaced, for comparison; then checkpoints, full and after a few
+*	results, and opening the file again
+*/
+void bench_players() {
+	PlayerStore<BenchPlayer> store;
+	BenchPlayer p, *records;
+	long i, j, found = 0, scans = 200, touched = 1000;
+	double start, add_s, hit_s, miss_s, scan_s, full_s, dirty_s, open_s;
+	int fd = open(BENCH_RECORDS, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if(fd == -1 || store.open(BENCH_RECORDS, BENCH_PLAYERS) == -1) {
+		perror("PlayerStore->open()");
+		return;
+	}
+	close(fd);
+	records = store;
+
+	memset(&p, 0, sizeof(p));
+	start = now_seconds();
+	for(i = 0; i < BENCH_PLAYERS; i = i + 1) {
+		p.playerID = i*7 + 1;
+		store.add(p);
+	}
+	add_s = now_seconds() - start;
+
+	//ids in a scattered order, so every lookup misses the cache as a login would
+	start = now_seconds();
+	for(i = 0; i < BENCH_PLAYERS; i = i + 1) {
+		found = found + (store.find((i*7919 % BENCH_PLAYERS)*7 + 1) >= 0);
+	}
+	hit_s = now_seconds() - start;
+	start = now_seconds();
+	for(i = 0; i < BENCH_PLAYERS; i = i + 1) {
+		found = found + (store.find((i*7919 % BENCH_PLAYERS)*7 + 2) >= 0);
+	}
+	miss_s = now_seconds() - start;
+
+	start = now_seconds();
+	for(i = 0; i < scans; i = i + 1) {
+		p.playerID = (i*7919 % BENCH_PLAYERS)*7 + 1;
+		for(j = 0; j < store.count() && records[j].playerID != p.playerID; j = j + 1);
+		found = found + (j < store.count());
+	}
+	scan_s = now_seconds() - start;
+
+	start = now_seconds();
+	store.checkpoint();
+	full_s = now_seconds() - start;
+	for(i = 0; i < touched; i = i + 1) {
+		records[i*7919 % BENCH_PLAYERS].wins++;
+	}
+	start = now_seconds();
+	store.checkpoint();
+	dirty_s = now_seconds() - start;
+
+	store.close();
+	start = now_seconds();
+	store.open(BENCH_RECORDS, BENCH_PLAYERS);
+	open_s = now_seconds() - start;
+	unlink(BENCH_RECORDS);
+
+	printf("  add        %6.1f ns/record, %ld records, index of %ld slots\n", add_s*1e9/BENCH_PLAYERS,
+	       store.count(), store.index_slots());
+	printf("  find       %6.1f ns/lookup found, %.1f ns not found\n", hit_s*1e9/BENCH_PLAYERS,
+	       miss_s*1e9/BENCH_PLAYERS);
+	printf("  scan       %6.1f us/lookup  (%ld of %ld found)\n", scan_s*1e6/scans, found,
+	       BENCH_PLAYERS + scans);
+	printf("  checkpoint %6.1f ms all records, %.2f ms after %ld results\n", full_s*1e3, dirty_s*1e3, touched);
+	printf("  open       %6.1f us for %ld records\n", open_s*1e6, store.count());
+}
+
+/*
+*	The SysV semaphore against the futex one (futexsem.h) as a lock: forked
+*	processes each take it, bump a shared counter and give it back, for
+*	one process (no contention) up to more than there are cores. Then a
+*	process dies holding the futex one, and the next to wait gets it back.
+*/
+void bench_semaphore() {
+	Semaphore sysv(1, BENCH_SEM_KEY);
+	FutexSemaphore futex(1, BENCH_SEM_KEY + 1);
+	long *counter = (long *)mmap(NULL, sizeof(long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int procs[4] = {1, 2, ncpu, 2*ncpu + 2};
+	int i, lost = 0;
+	double sysv_s, futex_s, start;
+	pid_t pid;
+
+	for(i = 0; i < 4; i = i + 1) {
+		if(i > 0 && procs[i] <= procs[i - 1]) {
+			continue;
+		}
+		*counter = 0;
+		sysv_s = time_semaphore(&sysv, procs[i], counter);
+		lost = lost + (*counter != BENCH_SEM_ROUNDS);
+		*counter = 0;
+		futex_s = time_semaphore(&futex, procs[i], counter);
+		lost = lost + (*counter != BENCH_SEM_ROUNDS);
+		printf("  %2d processes  semop %6.1f ns, futex %6.1f ns a wait and signal  (%.1fx)\n", procs[i],
+		       sysv_s*1e9/BENCH_SEM_ROUNDS, futex_s*1e9/BENCH_SEM_ROUNDS, sysv_s/futex_s);
+	}
+	printf("  %s\n", lost ? "the counter came out wrong: the lock let two in at once" : "every count was kept");
+
+	if((pid = fork()) == 0) {
+		futex.wait();
+		_exit(0); //without signal()
+	}
+	waitpid(pid, NULL, 0);
+	start = now_seconds();
+	futex.wait();
+	printf("  holder died: the unit was back after %.0f ms, value %d while held\n", (now_seconds() - start)*1e3,
+	       futex.value());
+	futex.signal();
+
+	sysv.remove();
+	futex.remove();
+	munmap(counter, sizeof(long));
+}
+
+template<class S> double time_semaphore(S *sem, int procs, long *counter) {
+	double start = now_seconds();
+	long i;
+	int p;
+
+	for(p = 0; p < procs; p = p + 1) {
+		if(fork() == 0) {
+			for(i = 0; i < BENCH_SEM_ROUNDS / procs + (p < BENCH_SEM_ROUNDS % procs); i = i + 1) {
+				sem->wait();
+				*counter = *counter + 1;
+				sem->signal();
+			}
+			_exit(0);
+		}
+	}
+	for(p = 0; p < procs; p = p + 1) {
+		wait(NULL);
+	}
+	return now_seconds() - start;
+}
+
+/*
+*	Plays a random move allowed on b. Returns the game's Outcome after it.
+*/
+int random_ultimate_move(UltimateBoard *b) {
+	int sub, sq;
+
+	do {
+		sub = b->next == UltimateBoard::ANY ? rand() % 9 : b->next;
+		sq = rand() % 9;
+	} while(!b->allowed(sub) || b->taken(sub, sq));
+	return b->play(sub, sq, b->to_move());
+}
+
+/*
+*	Counts the marks in a row through (r, c) in each direction, square by
+*	square, for comparison. 1 if any line reaches 5.
+*/
+int gomoku_scan(Gomoku *b, int r, int c, char symbol) {
+	int dr[4] = {0, 1, 1, 1};
+	int dc[4] = {1, 0, 1, -1};
+	int d, run, i;
+
+	for(d = 0; d < 4; d = d + 1) {
+		run = 1;
+		for(i = 1; i < Gomoku::WIN; i = i + 1) {
+			if(r + dr[d]*i >= Gomoku::ROWS || c + dc[d]*i < 0 || c + dc[d]*i >= Gomoku::COLS ||
+			   b->at(r + dr[d]*i, c + dc[d]*i) != symbol) {
+				break;
+			}
+			run = run + 1;
+		}
+		for(i = 1; i < Gomoku::WIN; i = i + 1) {
+			if(r - dr[d]*i < 0 || c - dc[d]*i < 0 || c - dc[d]*i >= Gomoku::COLS ||
+			   b->at(r - dr[d]*i, c - dc[d]*i) != symbol) {
+				break;
+			}
+			run = run + 1;
+		}
+		if(run >= Gomoku::WIN) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+*	The forking server's original winner check, kept as it was for
+*	comparison but for an int index. It stops at the first row or column
+*	of three equal squares, even empty ones.
+*/
+char checkWinner(char board[][3]) {
+	int i;
+
+	//check horizontally
+	for(i = 0; i < 3; i=i+1) {
+		if(board[i][0] == board[i][1] && board[i][1] == board[i][2]) {
+			return board[i][0];
+		}
+	}
+
+	//check vertically
+	for(i = 0; i < 3; i=i+1) {
+		if(board[0][i] == board[1][i] && board[1][i] == board[2][i]) {
+			return board[0][i];
+		}
+	}
+
+	//check diagonals
+	if((board[0][0] == board[1][1] && board[1][1] == board[2][2]) ||
+	   (board[0][2] == board[1][1] && board[1][1] == board[2][0])) {
+		return board[1][1];
+	}
+
+	return 0;
+}
+
+/*
+*	Fills boards with positions from random games, stopping each game after
+*	a random number of moves or when it ends, so every position could come
+*	up in play. The same seed gives the same boards.
+*/
+int make_boards(Board *boards, int n, unsigned seed) {
+	int i, sq, stop;
+	char symbol;
+
+	srand(seed);
+	for(i = 0; i < n; i = i + 1) {
+		boards[i].clear();
+		stop = rand() % 10;
+		symbol = 'X';
+		while(boards[i].moves() < stop && OUTCOMES.status(boards[i]) == IN_PLAY) {
+			sq = rand() % 9;
+			if(boards[i].taken(sq)) {
+				continue;
+			}
+			boards[i].play(sq, symbol);
+			symbol = symbol == 'X' ? 'O' : 'X';
+		}
+	}
+	return n;
+}
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
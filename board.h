@@ -0,0 +1,190 @@
+//////////////////////////////////////////////////////////
+// C++ class for a tic-tac-toe board kept as bitboards
+
+// Filename:     board.h
+//////////////////////////////////////////////////////////
+// Squares are numbered 0 to 8 row by row, so the square
+// at row x, column y is 3*x + y and is bit 3*x + y of a
+// mask. X's squares and O's squares are one 9-bit mask
+// each: a square is free if neither has its bit, a move
+// sets one bit, and a player has won if their mask holds
+// all three bits of one of the eight line masks.
+//
+// This is the game core shared by the server, the bots
+// and the analysis tools; everything else (messages,
+// printing) decodes the masks back into squares.
+//
+// The board has 8 symmetries (4 rotations, each with or
+// without a mirror). canonical() picks the one position
+// of the 8 that caches store, and says which transform
+// got there so a move found for it can be mapped back.
+// The compiler works out a table of where every mask goes
+// under every transform, so each is two loads.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Board_H
+#define _ooipc_Board_H
+
+#include <stdint.h>
+
+// Where squares and masks go under each symmetry.
+// Transform t takes square s to square[t][s].
+struct BoardSymmetries {
+  uint8_t square[8][9];
+  uint8_t inverse[8][9];
+  uint16_t mask[8][512];
+
+  constexpr BoardSymmetries();
+};
+
+class Board {
+public:
+  uint16_t x;                  // squares taken by X
+  uint16_t o;                  // squares taken by O
+
+  static constexpr uint16_t FULL = 0777;
+  static constexpr uint16_t LINES[8] = {
+    0007, 0070, 0700,          // rows
+    0111, 0222, 0444,          // columns
+    0421, 0124                 // diagonals
+  };
+  static constexpr int TRANSFORMS = 8;
+  static constexpr int MOVE_OK = 0;            // check_move() results
+  static constexpr int MOVE_OUT_OF_RANGE = 1;
+  static constexpr int MOVE_TAKEN = 2;
+  static const BoardSymmetries SYMMETRIES;
+
+  Board(): x(0), o(0) { };
+  inline void clear();
+  inline int taken(int square) const;
+  inline int check_move(int row, int col) const;
+  inline void play(int square, char symbol);
+  inline char at(int square) const;
+  inline char winner() const;
+  inline int full() const;
+  inline int moves() const;
+  inline Board transform(int t) const;
+  inline Board canonical(int *t) const;
+  static inline int map_square(int square, int t);
+  static inline int unmap_square(int square, int t);
+};
+
+constexpr BoardSymmetries::BoardSymmetries(): square{}, inverse{}, mask{} {
+  int r, c, to = 0;
+
+  for (int t = 0; t < 8; t++) {
+    for (int s = 0; s < 9; s++) {
+      r = s / 3;
+      c = s % 3;
+      switch (t) {
+      case 0: to = 3*r + c; break;                 // as it is
+      case 1: to = 3*c + 2 - r; break;             // quarter turn clockwise
+      case 2: to = 3*(2 - r) + 2 - c; break;       // half turn
+      case 3: to = 3*(2 - c) + r; break;           // quarter turn back
+      case 4: to = 3*r + 2 - c; break;             // mirrored left to right
+      case 5: to = 3*(2 - r) + c; break;           // mirrored top to bottom
+      case 6: to = 3*c + r; break;                 // about the main diagonal
+      case 7: to = 3*(2 - c) + 2 - r; break;       // about the other diagonal
+      }
+      square[t][s] = to;
+      inverse[t][to] = s;
+    }
+    for (int m = 0; m < 512; m++) {
+      for (int s = 0; s < 9; s++) {
+        if ((m >> s) & 1) mask[t][m] |= 1 << square[t][s];
+      }
+    }
+  }
+}
+
+inline constexpr BoardSymmetries Board::SYMMETRIES;
+
+void Board::clear() {
+  x = o = 0;
+}
+
+// Nonzero if either player has the square.
+int Board::taken(int square) const {
+  return ((x | o) >> square) & 1;
+}
+
+// Whether a player may move at row, column, both as sent
+// on the wire: MOVE_OK, or MOVE_OUT_OF_RANGE or MOVE_TAKEN
+// for why not. Every place that takes a player's move
+// checks it here, so they all turn down the same moves.
+int Board::check_move(int row, int col) const {
+  if (row < 0 || row > 2 || col < 0 || col > 2) return MOVE_OUT_OF_RANGE;
+  if (taken(3*row + col)) return MOVE_TAKEN;
+  return MOVE_OK;
+}
+
+// Marks the square for 'X' or 'O'.
+void Board::play(int square, char symbol) {
+  if (symbol == 'X') x |= 1 << square;
+  else o |= 1 << square;
+}
+
+// 'X', 'O' or 0 for a free square, as the protocol sends it.
+char Board::at(int square) const {
+  if ((x >> square) & 1) return 'X';
+  if ((o >> square) & 1) return 'O';
+  return 0;
+}
+
+// 'X' or 'O' if that player has a whole line, else 0.
+char Board::winner() const {
+  for (int i = 0; i < 8; i++) {
+    if ((x & LINES[i]) == LINES[i]) return 'X';
+    if ((o & LINES[i]) == LINES[i]) return 'O';
+  }
+  return 0;
+}
+
+int Board::full() const {
+  return (x | o) == FULL;
+}
+
+// How many moves have been made.
+int Board::moves() const {
+  return __builtin_popcount(x | o);
+}
+
+// The board under symmetry t, 0 to 7.
+Board Board::transform(int t) const {
+  Board b;
+  b.x = SYMMETRIES.mask[t][x];
+  b.o = SYMMETRIES.mask[t][o];
+  return b;
+}
+
+// The least of the board's 8 images, comparing X's mask
+// then O's. *t is set to the transform that gives it;
+// ties go to the lowest.
+Board Board::canonical(int *t) const {
+  Board best = *this, b;
+  uint32_t key, best_key = (uint32_t)x << 9 | o;
+
+  *t = 0;
+  for (int i = 1; i < TRANSFORMS; i++) {
+    b = transform(i);
+    key = (uint32_t)b.x << 9 | b.o;
+    if (key < best_key) {
+      best = b;
+      best_key = key;
+      *t = i;
+    }
+  }
+  return best;
+}
+
+// Where square goes on the board transformed by t.
+int Board::map_square(int square, int t) {
+  return SYMMETRIES.square[t][square];
+}
+
+// The square that t takes to square, to map a move found
+// on a canonical board back to the board it came from.
+int Board::unmap_square(int square, int t) {
+  return SYMMETRIES.inverse[t][square];
+}
+#endif
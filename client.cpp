@@ -9,13 +9,13 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include "protocol.h"
-
-#define BUFFERSIZE 256
+#include "framing.h"
 
 void game_over(char *buffer, int len);
 void get_id(int socket);
 void do_turn(int socket);
 void print_board(char *buffer);
+void print_ultimate(char *buffer);
 void print_record(char *buffer);
 
 void invalid_turn(int socket, char *buffer, int len);
@@ -27,8 +27,11 @@ void print_ip( struct addrinfo *ai);
 int main(int argc, char *argv[])
 {
     int socket;  
-    char buffer[BUFFERSIZE];
+    FrameBuffer in(server_msg_len);
+    struct iovec iov[2];
+    char *buffer;
 	int numbytes = 0;
+	int len;
 
     //get a connection to server
     if ((socket = get_server_connection(HOST, HTTPPORT)) == -1) {
@@ -36,48 +39,68 @@ int main(int argc, char *argv[])
        exit(1);
     }
 
-	//receive from the server and act upon the command received
-	while((numbytes=recv(socket, buffer, sizeof(buffer),  0)) > 0) {
-	   if(numbytes < 0) {
-		  perror("recv");
-		  exit(1);
-		}
-		buffer[numbytes] = '\0';
-
-		switch(buffer[0]) {
-		case P_UID:
-			get_id(socket);
-			break;
-
-		case P_RECORD:
-			print_record(&buffer[1]);
-			break;
-
-		case P_WAIT:
-			printf("Waiting for other player...\n");
-			break;
-
-		case P_BOARD:
-			print_board(buffer);
-			break;
-
-		case P_YOUR_TURN:
-			print_board(&buffer[1]);
-			printf("\nEnter the location for your next move: ");
-			do_turn(socket);
-			break;
-
-		case P_INVALID:
-			invalid_turn(socket, buffer, sizeof(buffer));
-			continue;
-
-		case P_GAMEOVER:
-			game_over(buffer, sizeof(buffer));
-			print_board(&buffer[2]);
-			close(socket);
-			exit(0);
+	//receive from the server and act upon each command received
+	while((numbytes=readv(socket, iov, in.space(iov))) > 0) {
+		in.wrote(numbytes);
+
+		while((len = in.next(&buffer)) > 0) {
+			switch(buffer[0]) {
+			case P_UID:
+				get_id(socket);
+				break;
+
+			case P_RECORD:
+				print_record(&buffer[1]);
+				break;
+
+			case P_WAIT:
+				printf("Waiting for other player...\n");
+				break;
+
+			case P_BOARD:
+				print_board(buffer);
+				break;
+
+			case P_YOUR_TURN:
+				print_board(&buffer[1]);
+				printf("\nEnter the location for your next move: ");
+				do_turn(socket);
+				break;
+
+			case P_ULTIMATE_TURN:
+				print_ultimate(&buffer[1]);
+				if(buffer[82] >= 0) {
+					printf("Play on the board in row %d, column %d of boards.\n", buffer[82] / 3, buffer[82] % 3);
+				} else {
+					printf("Play on any open board.\n");
+				}
+				printf("\nEnter the row and column (0-8) for your next move: ");
+				do_turn(socket);
+				break;
+
+			case P_INVALID:
+				invalid_turn(socket, buffer, len);
+				break;
+
+			case P_GAMEOVER:
+				game_over(buffer, len);
+				print_board(&buffer[2]);
+				close(socket);
+				exit(0);
+
+			case P_ULTIMATE_GAMEOVER:
+				game_over(buffer, len);
+				print_ultimate(&buffer[2]);
+				close(socket);
+				exit(0);
+			}
+
+			in.consume(len);
 		}
-	   
+	}
+	if(numbytes < 0) {
+		perror("recv");
+		exit(1);
 	}
     
 }
@@ -97,6 +120,27 @@ void print_board(char *buffer) {
 	}
 }
 
+//prints the 9x9 grid of an ultimate game
+void print_ultimate(char *buffer) {
+	int row, col;
+	for (row = 0; row < 9; row++) {
+		if (row > 0 && row % 3 == 0) {
+			printf("------+-------+------\n");
+		}
+		for (col = 0; col < 9; col++) {
+			if (col > 0 && col % 3 == 0) {
+				printf("| ");
+			}
+			if(buffer[9*row + col] == 0) {
+				printf("_ ");
+			} else {
+				printf("%c ", buffer[9*row + col]);
+			}
+		}
+		printf("\n");
+	}
+}
+
 void print_record(char *buffer) {
 	printf("playerID: %d, firstName: %s, lastName: %s, wins: %d, losses: %d, ties: %d\n", buffer[0], &buffer[1], &buffer[11], buffer[22], buffer[23], buffer[24]);
 }
@@ -104,10 +148,12 @@ void print_record(char *buffer) {
 //handles the user enter his player id
 void get_id(int socket) {
 	char msg[2];
+	int id = 0;
 	msg[0] = P_UID;
 	
 	printf("Please type your player id: ");
-	scanf("%d", &msg[1]);
+	scanf("%d", &id);
+	msg[1] = id;
 
 	if(send(socket, msg, sizeof(msg), 0) < 0) {
 		perror("could not send.");
@@ -118,9 +164,12 @@ void get_id(int socket) {
 //handles the user taking his turn
 void do_turn(int socket) {
 	char msg[3];
+	int x = -1, y = -1;
 	msg[0] = P_MOVE;
 
-	scanf("%d %d", &msg[1], &msg[2]);
+	scanf("%d %d", &x, &y);
+	msg[1] = x;
+	msg[2] = y;
 
 	if(send(socket, msg, sizeof(msg), 0) < 0) {
 		perror("could not send.");
@@ -139,6 +188,9 @@ void invalid_turn(int socket, char *buffer, int len) {
 		break;
 	case Q_LOC_TAKEN:
 		printf("Location taken.\n");
+		break;
+	case Q_WRONG_BOARD:
+		printf("That board is not the one to play on.\n");
 	}
 }
 
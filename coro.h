@@ -0,0 +1,130 @@
+//////////////////////////////////////////////////////////
+// C++20 coroutine types for running a match on any executor
+
+// Filename:     coro.h
+//////////////////////////////////////////////////////////
+// A Task is a coroutine that starts running as soon as it
+// is called and stays suspended after it returns, so its
+// owner can test done() and then destroy() it.
+//
+// An Inbox lets a coroutine wait for a message from one
+// of several senders (the two seats of a match). Whatever
+// reads the sockets - a blocking loop, epoll, io_uring or
+// a test - hands messages over with deliver(), which
+// resumes the coroutine if it was waiting for that sender.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Coro_H
+#define _ooipc_Coro_H
+
+#include <coroutine>
+#include <exception>
+
+class Task {
+public:
+  struct promise_type {
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  Task(): h(nullptr) { };
+  Task(std::coroutine_handle<promise_type> handle): h(handle) { };
+  Task(Task&& other): h(other.h) { other.h = nullptr; };
+  Task& operator =(Task&& other);
+  ~Task();
+  inline int done();
+  inline void destroy();
+private:
+  std::coroutine_handle<promise_type> h;
+};
+
+inline Task& Task::operator =(Task&& other) {
+  if (this != &other) {
+    destroy();
+    h = other.h;
+    other.h = nullptr;
+  }
+  return *this;
+}
+
+inline Task::~Task() {
+  destroy();
+}
+
+// Nonzero once the coroutine has run to the end.
+int Task::done() {
+  return h && h.done();
+}
+
+// Frees the coroutine frame, whether it finished or not.
+void Task::destroy() {
+  if (h) {
+    h.destroy();
+    h = nullptr;
+  }
+}
+
+class Inbox {
+  std::coroutine_handle<> waiter;
+  int expected;               // sender being waited for, or -1
+  char *data;
+  int len;
+public:
+  struct Message {
+    char *data;
+    int len;
+  };
+
+  struct Awaiter {
+    Inbox *inbox;
+    int from;
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+      inbox->waiter = h;
+      inbox->expected = from;
+    }
+    Message await_resume() {
+      Message msg = { inbox->data, inbox->len };
+      return msg;
+    }
+  };
+
+  Inbox(): waiter(nullptr), expected(-1), data(0), len(0) { };
+  inline Awaiter recv(int from);
+  inline int waiting_for();
+  inline int deliver(int from, char *buf, int count);
+};
+
+// co_await inbox.recv(from) suspends until deliver(from, ...).
+Inbox::Awaiter Inbox::recv(int from) {
+  Awaiter a = { this, from };
+  return a;
+}
+
+// The sender the coroutine is waiting for, or -1.
+int Inbox::waiting_for() {
+  return expected;
+}
+
+// Resumes the coroutine with buf if it is waiting for
+// this sender. Returns 0 (and drops buf) otherwise. buf
+// only has to stay valid until the coroutine suspends
+// again or finishes.
+int Inbox::deliver(int from, char *buf, int count) {
+  std::coroutine_handle<> h = waiter;
+  if (from != expected || !h) {
+    return 0;
+  }
+  waiter = nullptr;
+  expected = -1;
+  data = buf;
+  len = count;
+  h.resume();
+  return 1;
+}
+#endif
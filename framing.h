@@ -0,0 +1,138 @@
+//////////////////////////////////////////////////////////
+// C++ class for splitting a byte stream into protocol
+// messages
+
+// Filename:     framing.h
+//////////////////////////////////////////////////////////
+// TCP is free to merge messages or split them anywhere,
+// so bytes from the socket go into a FrameBuffer, a ring
+// the size of a few dozen messages, and whole messages
+// are taken out of it one at a time. Every message type
+// has a fixed length, so the first byte says how many
+// bytes to wait for. One read can bring in any number of
+// messages and a message can arrive over several reads;
+// nothing is allocated along the way.
+//
+// The lengths differ by direction (P_UID is one byte
+// from the server and two from a client), so the buffer
+// is given the table for the side it reads from. A type
+// the table does not know is passed on as a one byte
+// message for the caller to reject.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Framing_H
+#define _ooipc_Framing_H
+
+#include <string.h>
+#include <sys/uio.h>
+#include "protocol.h"
+
+class FrameBuffer {
+public:
+  enum { SIZE = 512, MAX_MESSAGE = 96 };
+
+  FrameBuffer(int (*length)(char type));
+  inline int space(struct iovec iov[2]);
+  inline char *write_ptr(int *len);
+  inline void wrote(int count);
+  inline int next(char **msg);
+  inline void consume(int len);
+  inline int pending();
+private:
+  char buf[SIZE];
+  char scratch[MAX_MESSAGE];   // a message that wraps round the end
+  unsigned head;               // next byte to take out, never wraps
+  unsigned tail;               // next byte to fill
+  int (*length)(char type);
+};
+
+// Length of each message the server sends, or 0.
+inline int server_msg_len(char type) {
+  switch (type) {
+  case P_UID:       return P_UID_LEN;
+  case P_WAIT:      return P_WAIT_LEN;
+  case P_RECORD:    return P_RECORD_LEN;
+  case P_YOUR_TURN: return P_YOUR_TURN_LEN;
+  case P_INVALID:   return P_INVALID_LEN;
+  case P_GAMEOVER:  return P_GAMEOVER_LEN;
+  case P_BOARD:     return P_BOARD_LEN;
+  case P_ULTIMATE_TURN: return P_ULTIMATE_TURN_LEN;
+  case P_ULTIMATE_GAMEOVER: return P_ULTIMATE_GAMEOVER_LEN;
+  }
+  return 0;
+}
+
+// Length of each message a client sends, or 0.
+inline int client_msg_len(char type) {
+  switch (type) {
+  case P_UID:       return P_UID_REPLY_LEN;
+  case P_MOVE:      return P_MOVE_LEN;
+  }
+  return 0;
+}
+
+inline FrameBuffer::FrameBuffer(int (*len)(char type)) {
+  head = tail = 0;
+  length = len;
+}
+
+// The free part of the ring as one or two pieces, for
+// readv(). Returns how many pieces there are.
+int FrameBuffer::space(struct iovec iov[2]) {
+  int room = SIZE - (tail - head);
+  int first = SIZE - tail % SIZE;
+
+  if (first > room) first = room;
+  iov[0].iov_base = &buf[tail % SIZE];
+  iov[0].iov_len = first;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = room - first;
+  return room > first ? 2 : 1;
+}
+
+// The first free piece, for a plain recv().
+char *FrameBuffer::write_ptr(int *len) {
+  struct iovec iov[2];
+  space(iov);
+  *len = iov[0].iov_len;
+  return (char *)iov[0].iov_base;
+}
+
+// Counts count bytes just read into the free space.
+void FrameBuffer::wrote(int count) {
+  tail += count;
+}
+
+// Points msg at the next whole message and returns its
+// length, or returns 0 if it has not all arrived yet.
+// msg stays valid until consume().
+int FrameBuffer::next(char **msg) {
+  unsigned at = head % SIZE;
+  int len, first;
+
+  if (tail == head) return 0;
+  len = length(buf[at]);
+  if (len <= 0 || len > MAX_MESSAGE) len = 1;
+  if ((int)(tail - head) < len) return 0;
+
+  first = SIZE - at;
+  if (first >= len) {
+    *msg = &buf[at];
+  } else {
+    memcpy(scratch, &buf[at], first);
+    memcpy(&scratch[first], buf, len - first);
+    *msg = scratch;
+  }
+  return len;
+}
+
+// Drops the message next() returned.
+void FrameBuffer::consume(int len) {
+  head += len;
+}
+
+// Bytes read but not yet taken out as messages.
+int FrameBuffer::pending() {
+  return tail - head;
+}
+#endif
@@ -0,0 +1,276 @@
+//////////////////////////////////////////////////////////
+// C++ class for process-shared semaphores on a futex
+
+// Filename:     futexsem.h
+//////////////////////////////////////////////////////////
+// FutexSemaphore has the interface of Semaphore
+// (semaphore.h), for use as a lock or a pool of units in
+// which every unit is given back by the process that took
+// it. Its count is an int in a SysV shared memory segment
+// found by key, so processes share one the way they share
+// a Semaphore, whether they were forked from each other
+// or not. It is not for one process to signal another
+// with: see below.
+//
+// When nobody has to wait, wait() and signal() are an
+// atomic operation or two in user space, where semop()
+// is a system call every time. Only a wait() that finds
+// the count at 0 sleeps in the kernel, on a futex on the
+// count, and only a signal() that sees someone asleep
+// makes the call to wake them.
+//
+// A unit taken by wait() is noted against the process
+// that took it until it gives it back with signal(), much
+// as semop() does with SEM_UNDO. If the process dies in
+// between, as a subserver that calls exit() in a critical
+// section does, a process waiting for the unit finds the
+// holder gone within RECOVER_MS and gives it back. Only a
+// death in the few instructions between taking a unit and
+// noting it can lose one. A note names the process by its
+// pid and start time, so a new process that happens to
+// get a dead holder's pid does not keep its unit held.
+//
+// That is why a unit must come back from the process that
+// took it: if one process waits and another signals, the
+// waiter's note is never cleared, and once the waiter is
+// gone its unit would be given back a second time.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_FutexSemaphore_H
+#define _ooipc_FutexSemaphore_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+class FutexSemaphore {
+public:
+  enum { MAX_HOLDERS = 64, RECOVER_MS = 50 };
+
+  FutexSemaphore(int value, int key);
+  ~FutexSemaphore();
+  void remove();
+  inline void wait();
+  inline void signal();
+  inline void P();
+  inline void V();
+  inline int value();
+private:
+  struct State {
+    int count;                 // units free; the futex word
+    int waiters;               // asleep on count
+    int ready;                 // count has its first value
+    uint64_t holders[MAX_HOLDERS]; // a process per unit taken (see self()), 0 if free
+  };
+
+  int id;
+  State *state;
+
+  inline void hold();
+  inline void release();
+  void recover();
+  inline void wake();
+  static inline uint64_t self();
+  static uint32_t start_time(pid_t pid);
+};
+
+// Attaches to the semaphore for key, creating it with
+// value if there is none yet.
+inline FutexSemaphore::FutexSemaphore(int value, int key) {
+  int created = 1;
+
+  id = shmget(key, sizeof(State), 0777 | IPC_CREAT | IPC_EXCL);
+  if (id == -1 && errno == EEXIST) {
+    created = 0;
+    id = shmget(key, sizeof(State), 0777);
+  }
+  if (id == -1) {
+    perror("FutexSemaphore");
+    exit(1);
+  }
+  state = (State *)shmat(id, NULL, 0);
+  if ((long)state == -1) {
+    perror("FutexSemaphore->shmat()");
+    exit(1);
+  }
+
+  if (created) {
+    state->count = value;
+    __atomic_store_n(&state->ready, 1, __ATOMIC_RELEASE);
+  } else {
+    //whoever created it may still be setting it up
+    while (!__atomic_load_n(&state->ready, __ATOMIC_ACQUIRE)) sched_yield();
+  }
+}
+
+inline FutexSemaphore::~FutexSemaphore() {
+  if (state != NULL) shmdt(state);
+  state = NULL;
+}
+
+// This process as a note: its pid in the high 32 bits and
+// its start time in the low. Working it out takes system
+// calls, so it is kept, and forgotten in a child after
+// fork().
+uint64_t FutexSemaphore::self() {
+  static uint64_t me = 0;
+  static int forgets = pthread_atfork(NULL, NULL, [] { __atomic_store_n(&me, 0, __ATOMIC_RELAXED); });
+  uint64_t m = __atomic_load_n(&me, __ATOMIC_RELAXED);
+  pid_t pid;
+
+  (void)forgets;
+  if (m == 0) {
+    pid = getpid();
+    m = (uint64_t)(uint32_t)pid << 32 | start_time(pid);
+    __atomic_store_n(&me, m, __ATOMIC_RELAXED);
+  }
+  return m;
+}
+
+// When process pid started, in clock ticks since boot (the
+// 22nd field of /proc/pid/stat), or 0 if it cannot be read.
+inline uint32_t FutexSemaphore::start_time(pid_t pid) {
+  char path[64], buf[1024], *p;
+  unsigned long long start = 0;
+  ssize_t n;
+  int fd, field;
+
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) return 0;
+  n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) return 0;
+  buf[n] = 0;
+
+  //the name in parentheses may hold spaces; count fields after it
+  if ((p = strrchr(buf, ')')) == NULL) return 0;
+  for (field = 2; field < 22 && *p != 0; p++) {
+    if (*p == ' ') field++;
+  }
+  if (field == 22) start = strtoull(p, NULL, 10);
+  return (uint32_t)start;
+}
+
+void FutexSemaphore::wait() {
+  struct timespec timeout = {0, RECOVER_MS * 1000000L};
+  int c;
+  long r;
+
+  while (1) {
+    c = __atomic_load_n(&state->count, __ATOMIC_RELAXED);
+    while (c > 0) {
+      if (__atomic_compare_exchange_n(&state->count, &c, c - 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        hold();
+        return;
+      }
+    }
+
+    //the kernel only puts us to sleep if the count is still 0
+    __atomic_fetch_add(&state->waiters, 1, __ATOMIC_SEQ_CST);
+    r = syscall(SYS_futex, &state->count, FUTEX_WAIT, 0, &timeout, NULL, 0);
+    __atomic_fetch_sub(&state->waiters, 1, __ATOMIC_RELAXED);
+    if (r == -1 && errno == ETIMEDOUT) recover();
+  }
+}
+
+void FutexSemaphore::signal() {
+  release();
+  __atomic_fetch_add(&state->count, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&state->waiters, __ATOMIC_SEQ_CST) > 0) wake();
+}
+
+void FutexSemaphore::P() {
+  wait();
+}
+
+void FutexSemaphore::V() {
+  signal();
+}
+
+int FutexSemaphore::value() {
+  return __atomic_load_n(&state->count, __ATOMIC_RELAXED);
+}
+
+void FutexSemaphore::wake() {
+  syscall(SYS_futex, &state->count, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Notes a unit taken by this process, in the first free
+// slot from one picked by pid so processes rarely meet.
+// With every slot taken the unit goes unnoted.
+void FutexSemaphore::hold() {
+  uint64_t me = self(), none;
+  int start = (me >> 32) % MAX_HOLDERS;
+
+  for (int i = 0; i < MAX_HOLDERS; i++) {
+    none = 0;
+    if (__atomic_compare_exchange_n(&state->holders[(start + i) % MAX_HOLDERS], &none, me, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+}
+
+// Drops one of this process's notes, if it has one; a
+// signal() without a wait() first has none.
+void FutexSemaphore::release() {
+  uint64_t me = self(), held;
+  int start = (me >> 32) % MAX_HOLDERS;
+
+  for (int i = 0; i < MAX_HOLDERS; i++) {
+    held = me;
+    if (__atomic_compare_exchange_n(&state->holders[(start + i) % MAX_HOLDERS], &held, 0, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+}
+
+// Gives back every unit held by a process that no longer
+// exists, or whose pid now belongs to a process that
+// started later; a child that has exited but not been
+// reaped still exists. A unit is only given back by
+// whoever clears its note, so two waiters at once cannot
+// both do it.
+inline void FutexSemaphore::recover() {
+  uint64_t note;
+  pid_t pid;
+  uint32_t started;
+
+  for (int i = 0; i < MAX_HOLDERS; i++) {
+    note = __atomic_load_n(&state->holders[i], __ATOMIC_RELAXED);
+    pid = note >> 32;
+    if (note == 0 || note == self()) continue;
+    if (kill(pid, 0) == 0 || errno != ESRCH) {
+      //alive, unless the pid has been given to a new process
+      started = start_time(pid);
+      if (started == 0 || started == (uint32_t)note) continue;
+    }
+    if (__atomic_compare_exchange_n(&state->holders[i], &note, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      __atomic_fetch_add(&state->count, 1, __ATOMIC_SEQ_CST);
+      wake();
+    }
+  }
+}
+
+// Removes the segment; it goes away once the last
+// process detaches.
+inline void FutexSemaphore::remove() {
+  if (id != -1) {
+    shmctl(id, IPC_RMID, NULL);
+    id = -1;
+  }
+}
+#endif
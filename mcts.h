@@ -0,0 +1,328 @@
+//////////////////////////////////////////////////////////
+// C++ class template for a parallel Monte Carlo tree
+// search
+
+// Filename:     mcts.h
+//////////////////////////////////////////////////////////
+// search() plays random games (playouts) from a position
+// for as long as it is given, on every thread of a pool
+// at once, and answers with the move that was tried the
+// most. Each playout walks down the tree picking children
+// by UCT, adds a level once a node has been visited a few
+// times, plays the rest of the game at random and adds
+// the result to every node on its path.
+//
+// The tree is shared without locks. A node's visit and
+// score counts are plain ints changed with atomic adds. A
+// visit is counted on the way down and the score only on
+// the way back, so until a playout finishes its path
+// looks like a loss (a virtual loss) and other threads
+// spread out over other moves instead of all following
+// it. Nodes come from one array allocated up front, by
+// an atomic add on how much is used; a node is expanded
+// by whichever thread first swaps its state to EXPANDING,
+// and others just play out from it until it is done.
+//
+// B is an MnkBoard, or anything with the same ROWS, COLS,
+// SQUARES, taken(), play() and full(). Searches do not
+// overlap; call search() from one thread at a time.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Mcts_H
+#define _ooipc_Mcts_H
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+template<class B> class Mcts {
+public:
+  Mcts(int threads, long max_nodes);
+  ~Mcts();
+  int search(const B &board, char symbol, long budget_us);
+  long playouts();
+  int threads();
+private:
+  enum { UNEXPANDED = 0, EXPANDING = 1, EXPANDED = 2 };
+  enum { EXPAND_AT = 2 };      // visits before a node gets children
+  enum { CLOCK_EVERY = 16 };   // playouts between looks at the clock
+
+  struct Node {
+    int visits;                // with the playouts still under way
+    int score;                 // 2 a win, 1 a draw, for whoever moved here
+    int state;
+    int count;                 // children
+    Node *children;
+    int move;                  // square, r*COLS + c
+  };
+
+  struct Pool {
+    Mcts *mcts;
+    int id;
+    pthread_t thread;
+    long playouts;
+    char pad[64];              // keep each thread's count on its own line
+  };
+
+  Node *nodes;
+  long max_nodes;
+  long used;
+  Node *root;
+  B position;
+  char to_move;
+  long deadline;               // CLOCK_MONOTONIC ns
+
+  Pool *pool;
+  int nthreads;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  long generation;             // searches started
+  int running;                 // threads still in the current search
+  int stopping;
+
+  static void *pool_loop(void *arg);
+  static long now();
+  void run(Pool *p);
+  void playout(uint64_t *rng);
+  Node *select(Node *n);
+  void expand(Node *n, const B &b);
+  static uint64_t next(uint64_t *rng);
+};
+
+template<class B> Mcts<B>::Mcts(int threads, long max) {
+  nthreads = threads < 1 ? 1 : threads;
+  max_nodes = max;
+  nodes = new Node[max_nodes];
+  used = 0;
+  generation = 0;
+  running = 0;
+  stopping = 0;
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&start, NULL);
+  pthread_cond_init(&done, NULL);
+
+  //the caller of search() is thread 0
+  pool = new Pool[nthreads]();
+  for (int i = 0; i < nthreads; i++) {
+    pool[i].mcts = this;
+    pool[i].id = i;
+    if (i > 0) pthread_create(&pool[i].thread, NULL, pool_loop, &pool[i]);
+  }
+}
+
+template<class B> Mcts<B>::~Mcts() {
+  pthread_mutex_lock(&lock);
+  stopping = 1;
+  pthread_cond_broadcast(&start);
+  pthread_mutex_unlock(&lock);
+  for (int i = 1; i < nthreads; i++) pthread_join(pool[i].thread, NULL);
+  pthread_mutex_destroy(&lock);
+  pthread_cond_destroy(&start);
+  pthread_cond_destroy(&done);
+  delete[] pool;
+  delete[] nodes;
+}
+
+template<class B> long Mcts<B>::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// xorshift64*, one state per thread.
+template<class B> uint64_t Mcts<B>::next(uint64_t *rng) {
+  *rng ^= *rng >> 12;
+  *rng ^= *rng << 25;
+  *rng ^= *rng >> 27;
+  return *rng * 2685821657736338717ULL;
+}
+
+// The square symbol should take on board, after playing
+// out for budget_us microseconds on every thread, or -1
+// if there is no free square.
+template<class B> int Mcts<B>::search(const B &board, char symbol, long budget_us) {
+  Node *best = NULL;
+
+  position = board;
+  to_move = symbol;
+  used = 1;
+  root = &nodes[0];
+  *root = Node();
+  expand(root, board);
+  if (root->count == 0) return -1;
+  deadline = now() + budget_us * 1000;
+
+  pthread_mutex_lock(&lock);
+  generation++;
+  running = nthreads;
+  pthread_cond_broadcast(&start);
+  pthread_mutex_unlock(&lock);
+
+  run(&pool[0]);
+
+  pthread_mutex_lock(&lock);
+  while (running > 0) pthread_cond_wait(&done, &lock);
+  pthread_mutex_unlock(&lock);
+
+  for (int i = 0; i < root->count; i++) {
+    if (best == NULL || root->children[i].visits > best->visits) best = &root->children[i];
+  }
+  return best->move;
+}
+
+// Playouts in the last search, from every thread.
+template<class B> long Mcts<B>::playouts() {
+  long total = 0;
+  for (int i = 0; i < nthreads; i++) total += pool[i].playouts;
+  return total;
+}
+
+template<class B> int Mcts<B>::threads() {
+  return nthreads;
+}
+
+template<class B> void *Mcts<B>::pool_loop(void *arg) {
+  Pool *p = (Pool *)arg;
+  Mcts *m = p->mcts;
+  long seen = 0;
+
+  while (1) {
+    pthread_mutex_lock(&m->lock);
+    while (m->generation == seen && !m->stopping) pthread_cond_wait(&m->start, &m->lock);
+    if (m->stopping) {
+      pthread_mutex_unlock(&m->lock);
+      return NULL;
+    }
+    seen = m->generation;
+    pthread_mutex_unlock(&m->lock);
+
+    m->run(p);
+  }
+}
+
+// One thread's share of a search: playouts until the
+// deadline.
+template<class B> void Mcts<B>::run(Pool *p) {
+  uint64_t rng = 0x9e3779b97f4a7c15ULL * (p->id + 1) ^ (uint64_t)generation << 32;
+  long n = 0;
+
+  do {
+    for (int i = 0; i < CLOCK_EVERY; i++) playout(&rng);
+    n += CLOCK_EVERY;
+  } while (now() < deadline);
+  p->playouts = n;
+
+  pthread_mutex_lock(&lock);
+  running--;
+  if (running == 0) pthread_cond_signal(&done);
+  pthread_mutex_unlock(&lock);
+}
+
+// The child to visit next by UCT; children not yet
+// visited come first.
+template<class B> typename Mcts<B>::Node *Mcts<B>::select(Node *n) {
+  double log_n = log((double)__atomic_load_n(&n->visits, __ATOMIC_RELAXED) + 1);
+  double value, best_value = -1;
+  Node *best = &n->children[0];
+  int visits, score;
+
+  for (int i = 0; i < n->count; i++) {
+    Node *c = &n->children[i];
+    visits = __atomic_load_n(&c->visits, __ATOMIC_RELAXED);
+    if (visits == 0) return c;
+    score = __atomic_load_n(&c->score, __ATOMIC_RELAXED);
+    value = score / (2.0 * visits) + 1.4 * sqrt(log_n / visits);
+    if (value > best_value) {
+      best_value = value;
+      best = c;
+    }
+  }
+  return best;
+}
+
+// Gives n a child for every free square, unless another
+// thread is already doing it or the node array is full.
+template<class B> void Mcts<B>::expand(Node *n, const B &b) {
+  int expected = UNEXPANDED;
+  int count = 0;
+  long at;
+
+  if (!__atomic_compare_exchange_n(&n->state, &expected, EXPANDING, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return;
+  }
+  for (int sq = 0; sq < B::SQUARES; sq++) {
+    if (!b.taken(sq / B::COLS, sq % B::COLS)) count++;
+  }
+  at = __atomic_fetch_add(&used, count, __ATOMIC_RELAXED);
+  if (at + count > max_nodes) {
+    __atomic_store_n(&n->state, UNEXPANDED, __ATOMIC_RELEASE);
+    return;
+  }
+
+  n->children = &nodes[at];
+  n->count = count;
+  count = 0;
+  for (int sq = 0; sq < B::SQUARES; sq++) {
+    if (b.taken(sq / B::COLS, sq % B::COLS)) continue;
+    n->children[count] = Node();
+    n->children[count].move = sq;
+    count++;
+  }
+  __atomic_store_n(&n->state, EXPANDED, __ATOMIC_RELEASE);
+}
+
+template<class B> void Mcts<B>::playout(uint64_t *rng) {
+  Node *path[B::SQUARES + 1];
+  int free_squares[B::SQUARES];
+  B b = position;
+  Node *n = root;
+  char symbol = to_move;
+  char winner = 0;
+  int depth = 0;
+  int nfree = 0;
+  int i, sq, reward;
+
+  //down the tree, counting each visit now (the virtual loss)
+  __atomic_fetch_add(&n->visits, 1, __ATOMIC_RELAXED);
+  path[depth++] = n;
+  while (__atomic_load_n(&n->state, __ATOMIC_ACQUIRE) == EXPANDED && n->count > 0) {
+    n = select(n);
+    __atomic_fetch_add(&n->visits, 1, __ATOMIC_RELAXED);
+    path[depth++] = n;
+    if (b.play(n->move / B::COLS, n->move % B::COLS, symbol)) {
+      winner = symbol;
+      break;
+    }
+    symbol = symbol == 'X' ? 'O' : 'X';
+    if (b.full()) break;
+    if (__atomic_load_n(&n->visits, __ATOMIC_RELAXED) >= EXPAND_AT) expand(n, b);
+  }
+
+  //then at random to the end
+  if (winner == 0 && !b.full()) {
+    for (sq = 0; sq < B::SQUARES; sq++) {
+      if (!b.taken(sq / B::COLS, sq % B::COLS)) free_squares[nfree++] = sq;
+    }
+    while (nfree > 0) {
+      i = next(rng) % nfree;
+      sq = free_squares[i];
+      free_squares[i] = free_squares[--nfree];
+      if (b.play(sq / B::COLS, sq % B::COLS, symbol)) {
+        winner = symbol;
+        break;
+      }
+      symbol = symbol == 'X' ? 'O' : 'X';
+    }
+  }
+
+  //the node at depth d was moved into by to_move if d is odd
+  for (i = 1; i < depth; i++) {
+    if (winner == 0) reward = 1;
+    else reward = (winner == to_move) == (i % 2 == 1) ? 2 : 0;
+    __atomic_fetch_add(&path[i]->score, reward, __ATOMIC_RELAXED);
+  }
+}
+#endif
@@ -0,0 +1,171 @@
+//////////////////////////////////////////////////////////
+// C++ class template for an m,n,k-game board
+
+// Filename:     mnk.h
+//////////////////////////////////////////////////////////
+// An M by N board where K in a row wins: 3,3,3 is
+// tic-tac-toe and 15,15,5 is Gomoku. Each player's marks
+// are kept a row to a 32-bit word, bit c for column c,
+// with K - 1 empty rows above the board and a few below
+// so a run of rows can be loaded from anywhere on it.
+//
+// Only a line through the last move can have just been
+// won, so play() checks no more than that, before it
+// stores the move so the loads do not wait on the store. The row is
+// a few shifts and ANDs. For the columns and diagonals
+// the K rows starting at each of the K rows a line could
+// start on are loaded as vectors of 8 rows, one lane per
+// starting row, and ANDed together, shifting lane bits by
+// one column per row for the diagonals; a lane is left
+// with bit c0 set if a line starts at its row and column
+// c0. Masks keep only the starts of lines through the
+// move. The cost is the same wherever the move is and
+// however big the board, and with -mavx2 each vector step
+// is one instruction (two with plain SSE2).
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Mnk_H
+#define _ooipc_Mnk_H
+
+#include <stdint.h>
+#include <string.h>
+
+//8 rows at a time: one AVX2 register, or two SSE2 ones
+typedef uint32_t MnkLanes __attribute__((vector_size(32)));
+
+template<int M, int N, int K> class MnkBoard {
+public:
+  static constexpr int ROWS = M;
+  static constexpr int COLS = N;
+  static constexpr int WIN = K;
+  static constexpr int SQUARES = M*N;
+
+  MnkBoard();
+  inline void clear();
+  inline int taken(int r, int c) const;
+  inline int play(int r, int c, char symbol);
+  inline char at(int r, int c) const;
+  inline int wins_through(int r, int c, char symbol) const;
+  inline int moves() const;
+  inline int full() const;
+private:
+  enum { LANES = sizeof(MnkLanes)/sizeof(uint32_t), PAD = K - 1 };
+
+  // Per lane j < K: 1, bit j and bit K - 1 - j, to be
+  // shifted to the column of the move; and for the ith
+  // load, 1 in the lane that holds the move's row.
+  struct Masks {
+    uint32_t first_k[LANES];
+    uint32_t step[LANES];
+    uint32_t step_back[LANES];
+    uint32_t move_row[K][LANES];
+    constexpr Masks();
+  };
+  static constexpr Masks MASKS{};
+
+  static_assert(K >= 2 && K <= LANES, "a line must fit in the lanes of one vector");
+  static_assert(K <= M || K <= N, "a line must fit on the board");
+  static_assert(N + K - 1 <= 32, "a row and its diagonal shifts must fit a word");
+
+  uint32_t x[PAD + M + LANES]; // X's rows, board row r at x[PAD + r]
+  uint32_t o[PAD + M + LANES];
+  int count;
+};
+
+template<int M, int N, int K> constexpr MnkBoard<M, N, K>::Masks::Masks(): first_k{}, step{}, step_back{},
+                                                                          move_row{} {
+  for (int j = 0; j < K; j++) {
+    first_k[j] = 1;
+    step[j] = 1u << j;
+    step_back[j] = 1u << (K - 1 - j);
+    move_row[j][K - 1 - j] = 1;
+  }
+}
+
+template<int M, int N, int K> MnkBoard<M, N, K>::MnkBoard() {
+  clear();
+}
+
+template<int M, int N, int K> void MnkBoard<M, N, K>::clear() {
+  memset(x, 0, sizeof(x));
+  memset(o, 0, sizeof(o));
+  count = 0;
+}
+
+template<int M, int N, int K> int MnkBoard<M, N, K>::taken(int r, int c) const {
+  return ((x[PAD + r] | o[PAD + r]) >> c) & 1;
+}
+
+// Marks the square for 'X' or 'O' and returns 1 if that
+// completed a line of K.
+template<int M, int N, int K> int MnkBoard<M, N, K>::play(int r, int c, char symbol) {
+  int won = wins_through(r, c, symbol);
+
+  if (symbol == 'X') x[PAD + r] |= 1u << c;
+  else o[PAD + r] |= 1u << c;
+  count++;
+  return won;
+}
+
+// 'X', 'O' or 0 for a free square.
+template<int M, int N, int K> char MnkBoard<M, N, K>::at(int r, int c) const {
+  if ((x[PAD + r] >> c) & 1) return 'X';
+  if ((o[PAD + r] >> c) & 1) return 'O';
+  return 0;
+}
+
+template<int M, int N, int K> int MnkBoard<M, N, K>::moves() const {
+  return count;
+}
+
+template<int M, int N, int K> int MnkBoard<M, N, K>::full() const {
+  return count == SQUARES;
+}
+
+// Nonzero if symbol has, or would have by taking (r, c),
+// K in a row through (r, c).
+template<int M, int N, int K> int MnkBoard<M, N, K>::wins_through(int r, int c, char symbol) const {
+  const uint32_t *rows = symbol == 'X' ? x : o;
+  const uint32_t *top = &rows[PAD + r - (K - 1)]; // lane j: a line starting K-1-j rows up
+  uint32_t row = rows[PAD + r] | 1u << c;
+  uint32_t run = row;
+  MnkLanes v, down, up, across, hit, move;
+  MnkLanes first_k, step, step_back;
+  uint32_t any = 0;
+
+  //along the row: bit c0 of run is set if K start at column c0
+  for (int i = 1; i < K; i++) run &= row >> i;
+  if (((run << (K - 1)) >> c) & ((1u << K) - 1)) return 1;
+
+  //down the column and both diagonals, every starting row at once
+  memcpy(&v, top, sizeof(v));
+  memcpy(&move, MASKS.move_row[0], sizeof(move));
+  v |= move << c;
+  down = v;
+  up = v;
+  across = v;
+#pragma GCC unroll 8
+  for (int i = 1; i < K; i++) {
+    memcpy(&v, top + i, sizeof(v));
+    memcpy(&move, MASKS.move_row[i], sizeof(move));
+    v |= move << c;
+    down &= v;
+    across &= v >> i;        // column c0 + i on row i of the line
+    up &= v << i;            // column c0 - i
+  }
+
+  //keep the starts of lines through (r, c): down the column at c in
+  //any lane, the diagonals at c - (K-1-j) and c + (K-1-j) in lane j
+  memcpy(&first_k, MASKS.first_k, sizeof(first_k));
+  memcpy(&step, MASKS.step, sizeof(step));
+  memcpy(&step_back, MASKS.step_back, sizeof(step_back));
+  hit = (down & (first_k << c)) |
+        ((across << (K - 1)) & (step << c)) |
+        (up & (step_back << c));
+  for (int j = 0; j < LANES; j++) any |= hit[j];
+  return any != 0;
+}
+
+typedef MnkBoard<3, 3, 3> TicTacToe;
+typedef MnkBoard<15, 15, 5> Gomoku;
+#endif
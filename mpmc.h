@@ -0,0 +1,138 @@
+//////////////////////////////////////////////////////////
+// C++ class for a bounded lock-free multi-producer,
+// multi-consumer queue
+
+// Filename:     mpmc.h
+//////////////////////////////////////////////////////////
+// Any number of threads may push() and pop() at once
+// without taking a lock. Every cell carries a sequence
+// number that says whether it is ready to be written or
+// read for the current lap around the ring, so a thread
+// only has to win one compare-and-swap on the head or
+// tail to own a cell. The capacity is rounded up to a
+// power of two.
+//
+// Given memory of memory_size() bytes, the queue keeps
+// its cells there instead of allocating them. With the
+// queue itself placed in shared memory as well, it can be
+// pushed to by processes forked after it was made.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Mpmc_H
+#define _ooipc_Mpmc_H
+
+#include <stddef.h>
+#include <new>
+
+template<class T> class MpmcQueue {
+  struct Cell {
+    size_t seq;
+    T data;
+  };
+  Cell *cells;
+  size_t mask;
+  bool owns_cells;
+  alignas(64) size_t head;     // next cell to push into
+  alignas(64) size_t tail;     // next cell to pop from
+public:
+  MpmcQueue(size_t capacity);
+  MpmcQueue(size_t capacity, void *memory);
+  ~MpmcQueue();
+  static size_t memory_size(size_t capacity);
+  bool push(const T& value);
+  bool pop(T& value);
+  size_t size();
+};
+
+template<class T> MpmcQueue<T>::MpmcQueue(size_t capacity) {
+  size_t n = 2;
+  while (n < capacity) n = n * 2;
+  cells = new Cell[n];
+  owns_cells = true;
+  for (size_t i = 0; i < n; i++) {
+    cells[i].seq = i;
+  }
+  mask = n - 1;
+  head = 0;
+  tail = 0;
+}
+
+template<class T> MpmcQueue<T>::MpmcQueue(size_t capacity, void *memory) {
+  size_t n = 2;
+  while (n < capacity) n = n * 2;
+  cells = (Cell *)memory;
+  owns_cells = false;
+  for (size_t i = 0; i < n; i++) {
+    new (&cells[i]) Cell();
+    cells[i].seq = i;
+  }
+  mask = n - 1;
+  head = 0;
+  tail = 0;
+}
+
+template<class T> MpmcQueue<T>::~MpmcQueue() {
+  if (owns_cells) delete[] cells;
+}
+
+// Bytes of memory the second constructor needs.
+template<class T> size_t MpmcQueue<T>::memory_size(size_t capacity) {
+  size_t n = 2;
+  while (n < capacity) n = n * 2;
+  return n * sizeof(Cell);
+}
+
+// Returns false if the queue is full.
+template<class T> bool MpmcQueue<T>::push(const T& value) {
+  size_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+  Cell *cell;
+  for (;;) {
+    cell = &cells[pos & mask];
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    long diff = (long)seq - (long)pos;
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    }
+  }
+  cell->data = value;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Returns false if the queue is empty.
+template<class T> bool MpmcQueue<T>::pop(T& value) {
+  size_t pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+  Cell *cell;
+  for (;;) {
+    cell = &cells[pos & mask];
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    long diff = (long)seq - (long)(pos + 1);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&tail, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    }
+  }
+  value = cell->data;
+  __atomic_store_n(&cell->seq, pos + mask + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Approximate number of queued values; exact when no
+// other thread is pushing or popping.
+template<class T> size_t MpmcQueue<T>::size() {
+  size_t t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+  size_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  return h > t ? h - t : 0;
+}
+#endif
@@ -0,0 +1,177 @@
+//////////////////////////////////////////////////////////
+// C++ class for a compile-time table of every tic-tac-toe
+// position
+
+// Filename:     outcome.h
+//////////////////////////////////////////////////////////
+// A position is numbered in base 3, one digit per square
+// (0 free, 1 X, 2 O, square 0 least significant), which
+// gives 3^9 = 19683 of them. For each one the table holds
+// a byte saying whether the game is over and how, who is
+// to move, whether the position can come up in a real
+// game, and how the game ends from there if both sides
+// play perfectly.
+//
+// The whole table is worked out by the compiler into
+// OUTCOMES, so it costs nothing at startup. A move only
+// ever adds to a position's number, so reachability is
+// one pass up the numbering and perfect-play values one
+// pass down it. Looking up a Board is then two loads to
+// number its masks and one for the entry.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Outcome_H
+#define _ooipc_Outcome_H
+
+#include <stdint.h>
+#include "board.h"
+
+enum Outcome : uint8_t {
+  IN_PLAY = 0,
+  X_WINS = 1,
+  O_WINS = 2,
+  DRAW = 3
+};
+
+class OutcomeTable {
+public:
+  static constexpr int POSITIONS = 19683;
+
+  constexpr OutcomeTable();
+  constexpr int index(const Board &b) const;
+  constexpr Outcome status(int index) const;
+  constexpr Outcome status(const Board &b) const;
+  constexpr Outcome value(int index) const;
+  constexpr char to_move(int index) const;
+  constexpr int reachable(int index) const;
+private:
+  enum {
+    STATUS = 0x03,             // Outcome of the position itself
+    VALUE = 0x0c,              // Outcome with perfect play, << 2
+    O_TO_MOVE = 0x10,
+    REACHABLE = 0x20
+  };
+  uint8_t entry[POSITIONS];
+  uint16_t ternary[512];       // number of a mask's squares as 1s
+
+  static constexpr void masks(int index, uint16_t *x, uint16_t *o);
+  static constexpr int has_line(uint16_t mask);
+  static constexpr int score(Outcome outcome, char player);
+};
+
+// Splits a position number back into X's and O's masks.
+constexpr void OutcomeTable::masks(int index, uint16_t *x, uint16_t *o) {
+  *x = *o = 0;
+  for (int sq = 0; sq < 9; sq++) {
+    if (index % 3 == 1) *x |= 1 << sq;
+    if (index % 3 == 2) *o |= 1 << sq;
+    index /= 3;
+  }
+}
+
+constexpr int OutcomeTable::has_line(uint16_t mask) {
+  for (int i = 0; i < 8; i++) {
+    if ((mask & Board::LINES[i]) == Board::LINES[i]) return 1;
+  }
+  return 0;
+}
+
+// How good an outcome is for player: 1 win, 0 draw, -1 loss.
+constexpr int OutcomeTable::score(Outcome outcome, char player) {
+  if (outcome == DRAW) return 0;
+  return (outcome == X_WINS) == (player == 'X') ? 1 : -1;
+}
+
+constexpr OutcomeTable::OutcomeTable(): entry{}, ternary{} {
+  uint16_t x = 0, o = 0;
+  int pow3[9] = {};
+  int i, sq, p, mover;
+  char player;
+  Outcome status, best, v;
+
+  p = 1;
+  for (sq = 0; sq < 9; sq++) {
+    pow3[sq] = p;
+    p *= 3;
+  }
+  for (i = 0; i < 512; i++) {
+    for (sq = 0; sq < 9; sq++) {
+      if ((i >> sq) & 1) ternary[i] += pow3[sq];
+    }
+  }
+
+  //what each position is on its own
+  for (i = 0; i < POSITIONS; i++) {
+    masks(i, &x, &o);
+    if (has_line(x)) status = X_WINS;
+    else if (has_line(o)) status = O_WINS;
+    else if ((x | o) == Board::FULL) status = DRAW;
+    else status = IN_PLAY;
+    entry[i] = status;
+    if (__builtin_popcount(x) > __builtin_popcount(o)) entry[i] |= O_TO_MOVE;
+  }
+
+  //reachable from the empty board by moves of an unfinished game
+  entry[0] |= REACHABLE;
+  for (i = 0; i < POSITIONS; i++) {
+    if (!(entry[i] & REACHABLE) || (entry[i] & STATUS) != IN_PLAY) continue;
+    mover = (entry[i] & O_TO_MOVE) ? 2 : 1;
+    masks(i, &x, &o);
+    for (sq = 0; sq < 9; sq++) {
+      if (!(((x | o) >> sq) & 1)) entry[i + mover*pow3[sq]] |= REACHABLE;
+    }
+  }
+
+  //perfect play, from full boards back towards the empty one
+  for (i = POSITIONS - 1; i >= 0; i--) {
+    if ((entry[i] & STATUS) != IN_PLAY) {
+      entry[i] |= (entry[i] & STATUS) << 2;
+      continue;
+    }
+    mover = (entry[i] & O_TO_MOVE) ? 2 : 1;
+    player = mover == 1 ? 'X' : 'O';
+    masks(i, &x, &o);
+    best = IN_PLAY;
+    for (sq = 0; sq < 9; sq++) {
+      if (((x | o) >> sq) & 1) continue;
+      v = (Outcome)((entry[i + mover*pow3[sq]] & VALUE) >> 2);
+      if (best == IN_PLAY || score(v, player) > score(best, player)) best = v;
+    }
+    entry[i] |= best << 2;
+  }
+}
+
+// The position number of a board.
+constexpr int OutcomeTable::index(const Board &b) const {
+  return ternary[b.x] + 2*ternary[b.o];
+}
+
+// Whether the game is over in this position, and how.
+constexpr Outcome OutcomeTable::status(int index) const {
+  return (Outcome)(entry[index] & STATUS);
+}
+
+constexpr Outcome OutcomeTable::status(const Board &b) const {
+  return status(index(b));
+}
+
+// How the game ends from here if both sides play
+// perfectly; the status if it is already over.
+constexpr Outcome OutcomeTable::value(int index) const {
+  return (Outcome)((entry[index] & VALUE) >> 2);
+}
+
+// 'X' or 'O', going by the number of marks each has.
+constexpr char OutcomeTable::to_move(int index) const {
+  return (entry[index] & O_TO_MOVE) ? 'O' : 'X';
+}
+
+// Nonzero if a game played by the rules can get here.
+constexpr int OutcomeTable::reachable(int index) const {
+  return entry[index] & REACHABLE;
+}
+
+inline constexpr OutcomeTable OUTCOMES;
+
+static_assert(OUTCOMES.value(0) == DRAW, "tic-tac-toe is a draw");
+#endif
@@ -0,0 +1,375 @@
+//////////////////////////////////////////////////////////
+// C++ class template for player records in a mapped
+// file, indexed by id
+
+// Filename:     playerstore.h
+//////////////////////////////////////////////////////////
+// A PlayerStore is the records file itself, mapped
+// shared: a PlayerStoreHeader, the records in the order
+// they were added, and an open-addressing hash index from
+// playerID to record number. The server maps it before it
+// forks, so every subserver and worker thread works on
+// the same records, and a change is in the page cache as
+// soon as it is made.
+//
+// open() costs the same few system calls however many
+// players there are: nothing is read or rebuilt, and
+// pages come in from disk as they are first used.
+// checkpoint() is an msync(), which writes back only the
+// pages changed since the last one. A file of bare
+// records, the layout before this one, is converted once,
+// through a temporary file renamed over it.
+//
+// The file is laid out when it is made for as many
+// records as it can ever hold, and never moves. It is
+// sparse, so disk and memory are only taken up as records
+// and index slots are first written, and growing is just
+// writing further in: a pointer to a record stays good
+// while the store is open.
+//
+// find() takes no lock. An index slot is one 64-bit word,
+// the id and the record number, stored atomically once
+// the record is in place, so a lookup sees the whole
+// record or no slot at all. add() takes a process-shared
+// mutex. Once the index would be more than half full it
+// builds one twice the size beside it and swaps it in by
+// a single store of the word that names the current one.
+// A lookup still in the old index finishes there safely,
+// as an old index is never written again.
+//
+// Counters in a record are changed by the caller with
+// atomic adds and need no lock; the rest of a record is
+// not changed once it is added. The add lock means
+// nothing to the next run, so it is kept in shared
+// memory made by open() rather than in the file.
+//
+// T is a record with an int playerID.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_PlayerStore_H
+#define _ooipc_PlayerStore_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PLAYERSTORE_MAGIC "TTTRECS"
+#define PLAYERSTORE_VERSION 1
+
+struct PlayerStoreHeader {
+  char magic[8];               // PLAYERSTORE_MAGIC
+  uint32_t version;            // PLAYERSTORE_VERSION
+  uint32_t record_size;        // sizeof(T)
+  uint64_t id;                 // picked at random when the file is made
+  uint64_t capacity;           // records the file is laid out for
+  uint64_t count;              // records added
+  uint64_t index;              // log2(slots) << 48 | first slot
+  uint64_t index_end;          // slots taken by every index so far
+};
+
+static_assert(sizeof(PlayerStoreHeader) == 56, "the file layout must not depend on the compiler");
+
+template<class T> class PlayerStore {
+public:
+  PlayerStore();
+  ~PlayerStore();
+  long open(const char *path, long capacity);
+  void close();
+  int checkpoint();
+  inline int find(int id) const;
+  inline int add(const T &record);
+  inline long count() const;
+  inline long capacity() const;
+  inline long index_slots() const;
+  inline uint64_t id() const;
+  inline operator T*();
+  inline T& operator [](int index);
+private:
+  enum { FIRST_SLOTS = 1024, PAGE = 4096, CONVERT_BATCH = 4096 };
+  static constexpr uint64_t OFFSET_MASK = (1ULL << 48) - 1;
+
+  struct Locks {
+    pthread_mutex_t add;
+  };
+
+  void *map;
+  size_t map_len;
+  PlayerStoreHeader *header;
+  T *records;
+  uint64_t *slots;             // every index, one after the other
+  Locks *locks;
+
+  static size_t file_size(uint64_t capacity, size_t *records_at, size_t *slots_at);
+  int map_file(int fd, uint64_t capacity);
+  long convert(const char *path, int old_fd, size_t old_len, long capacity);
+  static inline uint64_t hash(int id);
+  static inline void put(uint64_t *table, uint64_t mask, int id, long n);
+  void grow();
+  static inline void lock(pthread_mutex_t *m);
+};
+
+template<class T> PlayerStore<T>::PlayerStore(): map(NULL), map_len(0), header(NULL), records(NULL),
+                                                 slots(NULL), locks(NULL) {
+}
+
+template<class T> PlayerStore<T>::~PlayerStore() {
+  close();
+}
+
+// The size of a file laid out for capacity records, with
+// where the records and the index slots start.
+template<class T> size_t PlayerStore<T>::file_size(uint64_t capacity, size_t *records_at, size_t *slots_at) {
+  uint64_t max_slots = FIRST_SLOTS;
+
+  while (max_slots < 2 * capacity) max_slots *= 2;
+  //the header, the records, then every index up to the largest
+  *records_at = PAGE;
+  *slots_at = *records_at + (capacity * sizeof(T) + PAGE - 1) / PAGE * PAGE;
+  return *slots_at + 2 * max_slots * sizeof(uint64_t);
+}
+
+// Maps the records file at path. A file of bare records
+// is converted first, into one laid out for capacity.
+// Call it before forking. Returns the records converted,
+// 0 for a file already in this layout, or -1 with errno
+// set.
+template<class T> long PlayerStore<T>::open(const char *path, long capacity) {
+  pthread_mutexattr_t attr;
+  PlayerStoreHeader h;
+  struct stat st;
+  size_t records_at, slots_at;
+  long converted = 0;
+  int fd;
+
+  close();
+  locks = (Locks *)mmap(NULL, sizeof(Locks), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (locks == MAP_FAILED) {
+    locks = NULL;
+    return -1;
+  }
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&locks->add, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  if ((fd = ::open(path, O_RDWR | O_CLOEXEC)) == -1) return -1;
+  if (fstat(fd, &st) == -1) {
+    ::close(fd);
+    return -1;
+  }
+
+  if ((size_t)st.st_size >= sizeof(h) && pread(fd, &h, sizeof(h), 0) == sizeof(h) &&
+      memcmp(h.magic, PLAYERSTORE_MAGIC, sizeof(h.magic)) == 0) {
+    if (h.version != PLAYERSTORE_VERSION || h.record_size != sizeof(T) ||
+        (size_t)st.st_size != file_size(h.capacity, &records_at, &slots_at)) {
+      errno = EINVAL;
+      converted = -1;
+    } else if (map_file(fd, h.capacity) == -1) {
+      converted = -1;
+    }
+  } else if (st.st_size % sizeof(T) == 0) {
+    converted = convert(path, fd, st.st_size, capacity);
+  } else {
+    errno = EINVAL;
+    converted = -1;
+  }
+  ::close(fd);
+  return converted;
+}
+
+// Maps the file open on fd, laid out for capacity.
+template<class T> int PlayerStore<T>::map_file(int fd, uint64_t capacity) {
+  size_t records_at, slots_at, len = file_size(capacity, &records_at, &slots_at);
+
+  map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    map = NULL;
+    return -1;
+  }
+  map_len = len;
+  header = (PlayerStoreHeader *)map;
+  records = (T *)((char *)map + records_at);
+  slots = (uint64_t *)((char *)map + slots_at);
+  return 0;
+}
+
+// Makes a store at path.tmp from the old_len bytes of
+// bare records on old_fd, syncs it and renames it over
+// path. The mapping stays, and is then the store at path.
+template<class T> long PlayerStore<T>::convert(const char *path, int old_fd, size_t old_len, long capacity) {
+  char tmp[4096];
+  size_t records_at, slots_at, len = file_size(capacity, &records_at, &slots_at);
+  T *batch;
+  ssize_t got = 0;
+  long converted = 0;
+  int fd, saved;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  if ((fd = ::open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) return -1;
+  if (ftruncate(fd, len) == -1 || map_file(fd, capacity) == -1) {
+    saved = errno;
+    ::close(fd);
+    unlink(tmp);
+    errno = saved;
+    return -1;
+  }
+
+  memcpy(header->magic, PLAYERSTORE_MAGIC, sizeof(header->magic));
+  header->version = PLAYERSTORE_VERSION;
+  header->record_size = sizeof(T);
+  if (getrandom(&header->id, sizeof(header->id), 0) != sizeof(header->id)) header->id = time(NULL);
+  header->capacity = capacity;
+  header->count = 0;
+  header->index = (uint64_t)__builtin_ctzll(FIRST_SLOTS) << 48;
+  header->index_end = FIRST_SLOTS;
+
+  //many records a read, where the old load_records() made one read each
+  batch = new T[CONVERT_BATCH];
+  while ((size_t)converted * sizeof(T) < old_len && (got = read(old_fd, batch, CONVERT_BATCH * sizeof(T))) > 0) {
+    for (long i = 0; i < got / (long)sizeof(T); i++) add(batch[i]);
+    converted += got / sizeof(T);
+  }
+  delete[] batch;
+
+  if (got == -1 || fsync(fd) == -1 || rename(tmp, path) == -1) {
+    saved = errno;
+    ::close(fd);
+    unlink(tmp);
+    close();
+    errno = saved;
+    return -1;
+  }
+  ::close(fd);
+  return converted;
+}
+
+// Writes the pages changed since the last checkpoint back
+// to the file, and waits until they are on disk. Returns
+// 0, or -1 with errno set.
+template<class T> int PlayerStore<T>::checkpoint() {
+  return msync(map, map_len, MS_SYNC);
+}
+
+template<class T> void PlayerStore<T>::close() {
+  if (map != NULL) munmap(map, map_len);
+  if (locks != NULL) munmap(locks, sizeof(Locks));
+  map = NULL;
+  map_len = 0;
+  header = NULL;
+  records = NULL;
+  slots = NULL;
+  locks = NULL;
+}
+
+template<class T> uint64_t PlayerStore<T>::hash(int id) {
+  uint64_t h = (uint32_t)id * 0x9e3779b97f4a7c15ULL;
+  return h ^ (h >> 29);
+}
+
+// The number of the record with playerID id, or -1.
+template<class T> int PlayerStore<T>::find(int id) const {
+  uint64_t index = __atomic_load_n(&header->index, __ATOMIC_ACQUIRE);
+  const uint64_t *table = slots + (index & OFFSET_MASK);
+  uint64_t mask = (1ULL << (index >> 48)) - 1;
+  uint64_t slot;
+
+  for (uint64_t i = hash(id) & mask;; i = (i + 1) & mask) {
+    slot = __atomic_load_n(&table[i], __ATOMIC_ACQUIRE);
+    if (slot == 0) return -1;
+    if ((uint32_t)(slot >> 32) == (uint32_t)id) return (int)(slot & 0xffffffff) - 1;
+  }
+}
+
+// Slots hold the record number plus one, so 0 is empty.
+template<class T> void PlayerStore<T>::put(uint64_t *table, uint64_t mask, int id, long n) {
+  uint64_t i = hash(id) & mask;
+
+  while (table[i] != 0) i = (i + 1) & mask;
+  __atomic_store_n(&table[i], (uint64_t)(uint32_t)id << 32 | (uint64_t)(n + 1), __ATOMIC_RELEASE);
+}
+
+// Adds a copy of record and returns its number. If a
+// record with its id is already there, that one is kept
+// and its number returned; -1 if the store is full.
+template<class T> int PlayerStore<T>::add(const T &record) {
+  uint64_t index, mask;
+  long n;
+  int at;
+
+  lock(&locks->add);
+  at = find(record.playerID);
+  n = header->count;
+  if (at == -1 && n < (long)header->capacity) {
+    records[n] = record;
+    index = header->index;
+    if (2 * (uint64_t)(n + 1) > (1ULL << (index >> 48))) {
+      grow();
+      index = header->index;
+    }
+    mask = (1ULL << (index >> 48)) - 1;
+    put(slots + (index & OFFSET_MASK), mask, record.playerID, n);
+    __atomic_store_n(&header->count, n + 1, __ATOMIC_RELEASE);
+    at = n;
+  }
+  pthread_mutex_unlock(&locks->add);
+  return at;
+}
+
+// Builds an index twice the size after the last one and
+// makes it current. Called with the lock held. If the
+// caller dies part way, the next grow() starts the same
+// index over in the same slots.
+template<class T> void PlayerStore<T>::grow() {
+  int bits = (header->index >> 48) + 1;
+  uint64_t *table = slots + header->index_end;
+  uint64_t mask = (1ULL << bits) - 1;
+
+  memset(table, 0, (mask + 1) * sizeof(uint64_t));
+  for (uint64_t n = 0; n < header->count; n++) put(table, mask, records[n].playerID, n);
+  __atomic_store_n(&header->index, (uint64_t)bits << 48 | header->index_end, __ATOMIC_RELEASE);
+  header->index_end += 1ULL << bits;
+}
+
+// A holder that died (a subserver that exited) leaves the
+// lock to the next process; add() only makes its changes
+// visible at the end, so there is nothing to repair.
+template<class T> void PlayerStore<T>::lock(pthread_mutex_t *m) {
+  if (pthread_mutex_lock(m) == EOWNERDEAD) pthread_mutex_consistent(m);
+}
+
+template<class T> long PlayerStore<T>::count() const {
+  return __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+}
+
+template<class T> long PlayerStore<T>::capacity() const {
+  return header->capacity;
+}
+
+template<class T> long PlayerStore<T>::index_slots() const {
+  return 1L << (__atomic_load_n(&header->index, __ATOMIC_ACQUIRE) >> 48);
+}
+
+// Picked when the file was made, so a log can tell which
+// records file it belongs to.
+template<class T> uint64_t PlayerStore<T>::id() const {
+  return header->id;
+}
+
+template<class T> PlayerStore<T>::operator T*() {
+  return records;
+}
+
+template<class T> T& PlayerStore<T>::operator [](int index) {
+  return records[index];
+}
+#endif
@@ -10,6 +10,7 @@
 #define P_INVALID 3
 #define Q_OUT_OF_RANGE 0
 #define Q_LOC_TAKEN 1
+#define Q_WRONG_BOARD 2     //ultimate: not on the board the last move sent you to
 
 #define P_GAMEOVER 4
 #define Q_GAME_DRAW 0
@@ -17,3 +18,20 @@
 #define Q_YOU_LOST 2
 
 #define P_BOARD 5
+
+//ultimate tic-tac-toe: the 9x9 grid row by row, and P_MOVE is a row and column from 0 to 8
+#define P_ULTIMATE_TURN 8     //the grid, then the board to move on (0-8, row by row) or -1 for any
+#define P_ULTIMATE_GAMEOVER 9 //flag as for P_GAMEOVER, then the grid
+
+//length of each message in bytes, type included
+#define P_UID_LEN 1         //server asking for an id
+#define P_UID_REPLY_LEN 2   //client answering with one
+#define P_WAIT_LEN 1
+#define P_RECORD_LEN 26
+#define P_YOUR_TURN_LEN 10
+#define P_MOVE_LEN 3
+#define P_INVALID_LEN 2
+#define P_GAMEOVER_LEN 11
+#define P_BOARD_LEN 10
+#define P_ULTIMATE_TURN_LEN 83
+#define P_ULTIMATE_GAMEOVER_LEN 83
@@ -0,0 +1,198 @@
+//////////////////////////////////////////////////////////
+// C++ class for an index of waiting players by rating
+
+// Filename:     ratingindex.h
+//////////////////////////////////////////////////////////
+// Entries are kept in fixed-width rating buckets, each a
+// first-come first-served list, and in one list of every
+// entry by arrival. A bitmap of non-empty buckets finds
+// the nearest occupied bucket on either side of a rating
+// with a handful of word scans, so insert() and remove()
+// are O(1) and best_match() is O(buckets/64), however
+// many players are waiting.
+//
+// Entries are owned by the caller and must stay put
+// while they are in the index.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_RatingIndex_H
+#define _ooipc_RatingIndex_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+template<class T> class RatingIndex {
+public:
+  struct Entry {
+    T value;
+    int rating;
+    long since;                // when it was inserted, any unit
+    int bucket;
+    Entry *prev;               // within its bucket
+    Entry *next;
+    Entry *older;              // across the whole index
+    Entry *newer;
+  };
+
+  RatingIndex(int max_rating, int bucket_width);
+  ~RatingIndex();
+  void insert(Entry *e);
+  void remove(Entry *e);
+  Entry *best_match(Entry *e, int window);
+  Entry *oldest();
+  int size();
+private:
+  struct Bucket {
+    Entry *head;
+    Entry *tail;
+  };
+  Bucket *buckets;
+  uint64_t *occupied;          // bit per non-empty bucket
+  int nbuckets;
+  int width;
+  int count;
+  Entry *first;                // oldest entry
+  Entry *last;                 // newest entry
+
+  int bucket_of(int rating);
+  int next_occupied(int from, int to);
+  int prev_occupied(int from, int to);
+  Entry *first_other(int bucket, Entry *e);
+};
+
+template<class T> RatingIndex<T>::RatingIndex(int max_rating, int bucket_width) {
+  width = bucket_width;
+  nbuckets = max_rating / width + 1;
+  buckets = new Bucket[nbuckets];
+  memset(buckets, 0, nbuckets*sizeof(Bucket));
+  occupied = new uint64_t[(nbuckets + 63)/64];
+  memset(occupied, 0, ((nbuckets + 63)/64)*sizeof(uint64_t));
+  count = 0;
+  first = last = NULL;
+}
+
+template<class T> RatingIndex<T>::~RatingIndex() {
+  delete[] buckets;
+  delete[] occupied;
+}
+
+template<class T> int RatingIndex<T>::bucket_of(int rating) {
+  int b = rating / width;
+  if (b < 0) return 0;
+  if (b >= nbuckets) return nbuckets - 1;
+  return b;
+}
+
+// Adds e at the back of its bucket and of the index.
+template<class T> void RatingIndex<T>::insert(Entry *e) {
+  Bucket *b;
+
+  e->bucket = bucket_of(e->rating);
+  b = &buckets[e->bucket];
+  e->prev = b->tail;
+  e->next = NULL;
+  if (b->tail) b->tail->next = e; else b->head = e;
+  b->tail = e;
+  occupied[e->bucket/64] |= (uint64_t)1 << (e->bucket%64);
+
+  e->older = last;
+  e->newer = NULL;
+  if (last) last->newer = e; else first = e;
+  last = e;
+  count++;
+}
+
+template<class T> void RatingIndex<T>::remove(Entry *e) {
+  Bucket *b = &buckets[e->bucket];
+
+  if (e->prev) e->prev->next = e->next; else b->head = e->next;
+  if (e->next) e->next->prev = e->prev; else b->tail = e->prev;
+  if (b->head == NULL) {
+    occupied[e->bucket/64] &= ~((uint64_t)1 << (e->bucket%64));
+  }
+
+  if (e->older) e->older->newer = e->newer; else first = e->newer;
+  if (e->newer) e->newer->older = e->older; else last = e->older;
+  e->prev = e->next = e->older = e->newer = NULL;
+  count--;
+}
+
+// Lowest occupied bucket in [from, to], or -1.
+template<class T> int RatingIndex<T>::next_occupied(int from, int to) {
+  int w = from/64;
+  uint64_t bits;
+
+  if (from > to) return -1;
+  bits = occupied[w] & (~(uint64_t)0 << (from%64));
+  while (1) {
+    if (bits) {
+      int b = w*64 + __builtin_ctzll(bits);
+      return b <= to ? b : -1;
+    }
+    w++;
+    if (w*64 > to) return -1;
+    bits = occupied[w];
+  }
+}
+
+// Highest occupied bucket in [to, from], or -1.
+template<class T> int RatingIndex<T>::prev_occupied(int from, int to) {
+  int w = from/64;
+  uint64_t bits;
+
+  if (from < to) return -1;
+  bits = occupied[w] & (~(uint64_t)0 >> (63 - from%64));
+  while (1) {
+    if (bits) {
+      int b = w*64 + 63 - __builtin_clzll(bits);
+      return b >= to ? b : -1;
+    }
+    w--;
+    if (w < 0 || w*64 + 63 < to) return -1;
+    bits = occupied[w];
+  }
+}
+
+// Longest waiting entry in a bucket other than e.
+template<class T> typename RatingIndex<T>::Entry *RatingIndex<T>::first_other(int bucket, Entry *e) {
+  Entry *c = buckets[bucket].head;
+  if (c == e) c = c->next;
+  return c;
+}
+
+// The entry closest in rating to e, no more than window
+// away, preferring the longest waiting one in a bucket.
+// Returns NULL if there is none.
+template<class T> typename RatingIndex<T>::Entry *RatingIndex<T>::best_match(Entry *e, int window) {
+  int lo = bucket_of(e->rating - window);
+  int hi = bucket_of(e->rating + window);
+  Entry *best = first_other(e->bucket, e);
+  Entry *c;
+  int b, diff;
+  int best_diff = best ? abs(best->rating - e->rating) : window + 1;
+
+  b = e->bucket > lo ? prev_occupied(e->bucket - 1, lo) : -1;
+  if (b != -1 && (c = buckets[b].head) != NULL) {
+    diff = abs(c->rating - e->rating);
+    if (diff < best_diff) { best = c; best_diff = diff; }
+  }
+  b = e->bucket < hi ? next_occupied(e->bucket + 1, hi) : -1;
+  if (b != -1 && (c = buckets[b].head) != NULL) {
+    diff = abs(c->rating - e->rating);
+    if (diff < best_diff) { best = c; best_diff = diff; }
+  }
+
+  return best_diff <= window ? best : NULL;
+}
+
+// The entry that has been in the index longest; follow
+// newer from there to visit every entry by arrival.
+template<class T> typename RatingIndex<T>::Entry *RatingIndex<T>::oldest() {
+  return first;
+}
+
+template<class T> int RatingIndex<T>::size() {
+  return count;
+}
+#endif
@@ -0,0 +1,309 @@
+//////////////////////////////////////////////////////////
+// C++ class for the write-ahead log of game results
+
+// Filename:     recordlog.h
+//////////////////////////////////////////////////////////
+// Every result counted in a player record is appended
+// here as well, so what happened since the records file
+// was last checkpointed survives a crash or a kill: at
+// startup the log is replayed over the records file.
+//
+// append() only queues the entry, on a lock-free queue
+// (mpmc.h) in shared memory that subservers forked later
+// push to too. A commit thread in the server takes all
+// that has queued every window milliseconds, writes it
+// with one write() and syncs the file once for the lot
+// (group commit). A finishing match never waits for the
+// disk; a crash loses at most the last window's results.
+//
+// The file is a LogHeader and then LogEntry after
+// LogEntry, each with a checksum and a sequence number
+// one past the last. Replay stops at the first entry that
+// does not check out, a write torn by the crash, and cuts
+// the file there. The header carries the id of the
+// records file the log goes with; a log for any other
+// records file is thrown away and started again rather
+// than replayed onto records it does not belong to.
+//
+// An entry holds the counter's value after the change,
+// not the change, and replay keeps the larger of that and
+// what the records file has. Pages of the records file
+// may be written back at any time, so some entries are
+// already in it; replaying them again changes nothing.
+// Every checkpoint interval the commit thread has the
+// records file synced and then empties the log, as all
+// it held is then on disk in the file.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_RecordLog_H
+#define _ooipc_RecordLog_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "mpmc.h"
+
+#define RECORDLOG_MAGIC "TTTWLOG"
+#define RECORDLOG_VERSION 2
+
+enum LogKind : uint32_t { LOG_WIN = 1, LOG_LOSS = 2, LOG_TIE = 3 };
+
+struct LogHeader {
+  char magic[8];               // RECORDLOG_MAGIC
+  uint32_t version;            // RECORDLOG_VERSION
+  uint32_t entry_size;         // sizeof(LogEntry)
+  uint64_t base;               // id of the records file it goes with
+};
+
+struct LogEntry {
+  uint32_t checksum;           // of the rest of the entry
+  uint32_t kind;               // LogKind
+  uint64_t seq;                // 1 for the first entry in the file
+  int32_t player;              // playerID
+  int32_t value;               // the counter after the change
+};
+
+static_assert(sizeof(LogHeader) == 24 && sizeof(LogEntry) == 24,
+              "the file layout must not depend on the compiler");
+
+// FNV-1a, 64 bits; h carries on from an earlier call.
+inline uint64_t recordlog_checksum(const void *data, size_t len, uint64_t h = 14695981039346656037ULL) {
+  const uint8_t *p = (const uint8_t *)data;
+
+  for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 1099511628211ULL;
+  return h;
+}
+
+class RecordLog {
+public:
+  enum { QUEUE = 1 << 16 };    // results that can wait for a commit
+  typedef void (*Apply)(int player, int kind, int value);
+  typedef int (*Checkpoint)();
+
+  RecordLog();
+  long open(const char *path, uint64_t base, Apply apply);
+  int start(int window_ms, int checkpoint_s, Checkpoint checkpoint);
+  inline void append(int player, int kind, int value);
+  long commit();
+  long committed();
+  long syncs();
+  long checkpoints();
+  long dropped();
+private:
+  enum { SPINS = 1000 };       // tries at a full queue before a result is dropped
+
+  struct Pending {
+    int32_t player;
+    uint32_t kind;
+    int32_t value;
+  };
+
+  struct SharedState {
+    MpmcQueue<Pending> queue;
+    long dropped;              // by append(), from any process
+  };
+
+  int fd;
+  int wakefd;                  // poked when the queue fills up
+  int window;
+  int checkpoint_s;
+  Checkpoint checkpoint;
+  off_t end;                   // of the last entry synced
+  uint64_t next_seq;
+  SharedState *shared;
+  LogEntry *batch;             // entries taken off the queue, not yet synced
+  long batched;
+  long entries_committed;
+  long sync_count;
+  long checkpoint_count;
+  pthread_t thread;
+
+  static void *commit_loop(void *arg);
+  int empty();
+  static uint32_t entry_checksum(const LogEntry *e);
+};
+
+inline RecordLog::RecordLog(): fd(-1), wakefd(-1), window(0), checkpoint_s(0), checkpoint(NULL), end(0),
+                               next_seq(1), shared(NULL), batch(NULL), batched(0), entries_committed(0),
+                               sync_count(0), checkpoint_count(0) {
+}
+
+inline uint32_t RecordLog::entry_checksum(const LogEntry *e) {
+  return (uint32_t)recordlog_checksum(&e->kind, sizeof(LogEntry) - sizeof(e->checksum));
+}
+
+// Opens the log at path, replays it through apply() if it
+// goes with the records file with id base,
+// and sets up the queue; call it before forking. Returns
+// the entries replayed, or -1 with errno set.
+inline long RecordLog::open(const char *path, uint64_t base, Apply apply) {
+  LogHeader h;
+  ssize_t got;
+  long replayed = 0;
+  int good = 1;
+  void *memory;
+
+  if ((fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1) return -1;
+  batch = new LogEntry[QUEUE];
+  end = sizeof(LogHeader);
+
+  if (read(fd, &h, sizeof(h)) != sizeof(h) || memcmp(h.magic, RECORDLOG_MAGIC, sizeof(h.magic)) != 0 ||
+      h.version != RECORDLOG_VERSION || h.entry_size != sizeof(LogEntry) || h.base != base) {
+    //new, or for another records file: start over
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RECORDLOG_MAGIC, sizeof(h.magic));
+    h.version = RECORDLOG_VERSION;
+    h.entry_size = sizeof(LogEntry);
+    h.base = base;
+    if (ftruncate(fd, 0) == -1 || pwrite(fd, &h, sizeof(h), 0) != sizeof(h) || fsync(fd) == -1) return -1;
+  } else {
+    while (good && (got = read(fd, batch, QUEUE * sizeof(LogEntry))) > 0) {
+      for (long i = 0; good && i < got / (long)sizeof(LogEntry); i++) {
+        good = batch[i].seq == next_seq && batch[i].checksum == entry_checksum(&batch[i]);
+        if (!good) continue;
+        apply(batch[i].player, batch[i].kind, batch[i].value);
+        next_seq++;
+        end += sizeof(LogEntry);
+        replayed++;
+      }
+    }
+    //drop whatever follows the last good entry
+    if (ftruncate(fd, end) == -1 || fsync(fd) == -1) return -1;
+  }
+  if (lseek(fd, end, SEEK_SET) == -1) return -1;
+
+  memory = mmap(NULL, sizeof(SharedState) + MpmcQueue<Pending>::memory_size(QUEUE), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) return -1;
+  shared = (SharedState *)memory;
+  new (&shared->queue) MpmcQueue<Pending>(QUEUE, shared + 1);
+  shared->dropped = 0;
+  if ((wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) return -1;
+  return replayed;
+}
+
+// Starts the commit thread, which commits every window_ms
+// or sooner if the queue fills, and every checkpoint_s
+// seconds (never if 0) calls checkpoint() and empties the
+// log if it returns 0. Returns 0, or -1.
+inline int RecordLog::start(int window_ms, int checkpoint_seconds, Checkpoint checkpoint_records) {
+  window = window_ms < 1 ? 1 : window_ms;
+  checkpoint_s = checkpoint_seconds;
+  checkpoint = checkpoint_records;
+  return pthread_create(&thread, NULL, commit_loop, this) == 0 ? 0 : -1;
+}
+
+// Queues a result for the next commit, from any thread or
+// subserver. Waits only if a full queue stays full, and
+// drops the result if it is still full after that.
+void RecordLog::append(int player, int kind, int value) {
+  Pending p = {player, (uint32_t)kind, value};
+  uint64_t one = 1;
+
+  for (int i = 0; !shared->queue.push(p); i++) {
+    if (i == 0) write(wakefd, &one, sizeof(one));
+    if (i == SPINS) {
+      __atomic_fetch_add(&shared->dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    sched_yield();
+  }
+  if (shared->queue.size() == QUEUE / 2) write(wakefd, &one, sizeof(one));
+}
+
+inline void *RecordLog::commit_loop(void *arg) {
+  RecordLog *log = (RecordLog *)arg;
+  struct pollfd pfd = {log->wakefd, POLLIN, 0};
+  uint64_t pokes;
+  time_t next_checkpoint = time(NULL) + log->checkpoint_s;
+  long committed;
+
+  while (1) {
+    if (poll(&pfd, 1, log->window) > 0) read(log->wakefd, &pokes, sizeof(pokes));
+    if ((committed = log->commit()) == -1) perror("RecordLog->commit()");
+
+    //everything logged so far is in the records' pages by now
+    if (log->checkpoint_s > 0 && committed != -1 && time(NULL) >= next_checkpoint) {
+      if (log->checkpoint() == -1 || log->empty() == -1) perror("RecordLog->checkpoint()");
+      next_checkpoint = time(NULL) + log->checkpoint_s;
+    }
+  }
+  return NULL;
+}
+
+// Cuts the log back to its header once what it held has
+// been checkpointed. Returns 0, or -1.
+inline int RecordLog::empty() {
+  if (ftruncate(fd, sizeof(LogHeader)) == -1 || fsync(fd) == -1) return -1;
+  end = sizeof(LogHeader);
+  next_seq = 1;
+  __atomic_fetch_add(&checkpoint_count, 1, __ATOMIC_RELAXED);
+  return lseek(fd, end, SEEK_SET) == -1 ? -1 : 0;
+}
+
+// Writes everything queued and syncs it. Returns the
+// entries committed, or -1 if the write or sync failed;
+// then the file is cut back and the same entries are
+// tried again by the next commit.
+inline long RecordLog::commit() {
+  Pending p;
+  LogEntry *e;
+  size_t len, done = 0;
+  ssize_t n;
+  long count;
+
+  while (batched < QUEUE && shared->queue.pop(p)) {
+    e = &batch[batched++];
+    e->kind = p.kind;
+    e->seq = next_seq++;
+    e->player = p.player;
+    e->value = p.value;
+    e->checksum = entry_checksum(e);
+  }
+  if (batched == 0) return 0;
+
+  len = batched * sizeof(LogEntry);
+  while (done < len) {
+    n = write(fd, (char *)batch + done, len - done);
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1) break;
+    done += n;
+  }
+  if (done < len || fdatasync(fd) == -1) {
+    ftruncate(fd, end);
+    lseek(fd, end, SEEK_SET);
+    return -1;
+  }
+
+  end += len;
+  count = batched;
+  batched = 0;
+  __atomic_fetch_add(&entries_committed, count, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&sync_count, 1, __ATOMIC_RELAXED);
+  return count;
+}
+
+inline long RecordLog::committed() {
+  return __atomic_load_n(&entries_committed, __ATOMIC_RELAXED);
+}
+
+inline long RecordLog::syncs() {
+  return __atomic_load_n(&sync_count, __ATOMIC_RELAXED);
+}
+
+inline long RecordLog::checkpoints() {
+  return __atomic_load_n(&checkpoint_count, __ATOMIC_RELAXED);
+}
+
+inline long RecordLog::dropped() {
+  return shared == NULL ? 0 : __atomic_load_n(&shared->dropped, __ATOMIC_RELAXED);
+}
+#endif
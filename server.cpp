@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -14,15 +15,68 @@
 #include <netdb.h>
 #include <errno.h>
 #include <stdarg.h>
-#include "shared.h"
-#include "semaphore.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <poll.h>
 #include "protocol.h"
+#include "uring.h"
+#include "coro.h"
+#include "mpmc.h"
+#include "ratingindex.h"
+#include "timerwheel.h"
+#include "framing.h"
+#include "board.h"
+#include "outcome.h"
+#include "solver.h"
+#include "mnk.h"
+#include "mcts.h"
+#include "tablebase.h"
+#include "ultimate.h"
+#include "playerstore.h"
+#include "recordlog.h"
 
 #define BACKLOG 10
+#define MAX_EVENTS 64
+#define OUT_BUFFER 512       //output queued per client until the end of the batch
+#define ACCEPT_DEPTH 16      //accepts kept in flight by the io_uring backend
+#define URING_ENTRIES 4096
+#define LOBBY_SIZE 65536     //clients that can wait for an opponent at once
+#define LOBBY_BUCKETS 32
+
+//rating matchmaking in event loop mode
+#define RATING_MAX 4000
+#define RATING_BUCKET 25
+#define MATCH_WINDOW 50          //rating difference accepted straight away
+#define MATCH_WINDOW_GROWTH 50   //added for every second spent waiting
+#define MATCH_TICK_MS 100
+#define BOT_WAIT 30              //seconds in the lobby before the bot seat takes a game
+#define BOT_SEAT -2              //in place of a socket: the worker plays this seat
+#define BOT_PLAYER -2            //in place of a record: the bot seat has none
+#define PLANNER_NODES (1 << 20)  //tree nodes each planner's Monte Carlo search can grow
+#define PLANNER_QUEUE 1024       //bot moves waiting for a planner; past that the solver plays them
+
+//what every match on the server plays
+#define GAME_CLASSIC 0
+#define GAME_ULTIMATE 1
+
+//deadlines, in seconds unless set on the command line
+#define TURN_TIMEOUT 60           //to log in or make a move
+#define MATCH_TIMEOUT 900         //for the whole game
+#define TIMER_TICK_MS 10
+
+//tags in the low bits of an io_uring request's user_data
+#define OP_RECV 0
+#define OP_SEND 1
+#define OP_WAKE 2
+#define OP_MASK 3
 
 //asgn 7 - player records
-#define MEMORY_KEY 32500
-#define MAX_RECORDS 10
+#define MAX_PLAYERS (1 << 22)        //records a converted records file is laid out for
+#define LOG_WINDOW_MS 10             //results logged since are synced together
+#define CHECKPOINT_S 60              //records file synced and log emptied this often
 
 typedef struct PlayerRecord {
    int playerID;
@@ -33,361 +87,2419 @@ typedef struct PlayerRecord {
    int ties;
 } Player;
 
+struct MatchData;
+struct WorkerData;
+struct ConnData;
+
+//io_uring backend: buffers must live until the kernel completes
+typedef struct ConnIOData {
+   char sending[OUT_BUFFER];  //bytes owned by the send in flight
+   int send_len;
+   int send_off;
+   int in_flight;             //requests the kernel has not completed
+} ConnIO;
+
+typedef struct ConnData {
+   int sock;
+   int seat;                  //0 for client 1, 1 for client 2
+   struct MatchData *match;
+   FrameBuffer in{client_msg_len}; //what has arrived but not been handed to the game
+   char out[OUT_BUFFER];      //messages queued since the last send
+   int out_len;
+   int out_count;
+   int out_failed;            //a send failed, so the rest is dropped
+   int dirty;                 //on the worker's list of clients to flush
+   struct ConnData *next_dirty;
+   ConnIO *io;                //only with the io_uring backend
+   int bot;                   //played by the worker, which reads out[] instead of sending it
+   int thinking;              //the bot seat's move is being searched for by a planner
+} Conn;
+
+//a match is the coroutine play_match() plus the little state it shares
+//with whatever is reading its sockets
+typedef struct MatchData {
+   Conn conn[2];
+   int player_index[2];
+   Board board;
+   UltimateBoard ultimate;    //the grid instead, in ultimate mode
+   char turn;
+   int closed;
+   int handed_off;            //a logged in client goes to the lobby, not away
+   Inbox inbox;               //client messages are delivered here
+   Task task;                 //the game, suspended while it waits
+   Timer turn_timer;          //for the client the game is waiting for
+   Timer match_timer;
+   TimerWheel *timers;
+   struct WorkerData *worker; //NULL in a subserver
+   struct MatchData *next_dead;
+} Match;
+
+typedef struct HandoffData {
+   int sock[2];               //sock[1] is -1 for a client that has to log in
+   int player_index[2];
+   struct HandoffData *next;
+} Handoff;
+
+//a bot move for a planner to search for, then the worker to play
+typedef struct ThinkData {
+   struct MatchData *match;
+   int seat;
+   TicTacToe board;
+   char symbol;
+   int square;
+   long queued;               //CLOCK_MONOTONIC ns when it was queued
+   struct ThinkData *next;
+} Think;
+
+//one of the threads searching for bot moves, each with its own tree
+typedef struct PlannerData {
+   int id;
+   pthread_t thread;
+   Mcts<TicTacToe> *mcts;
+} Planner;
+
+typedef struct PlannerStatsData {
+   long moves;                //bot moves searched for
+   long wait_total;           //ns they waited for a planner
+   long wait_max;             //ns
+   long full;                 //moves the solver played because the queue was full
+} PlannerStats;
+
+typedef struct WorkerData {
+   int id;
+   int epfd;
+   int wakefd;                //eventfd poked when a hand-off is queued
+   pthread_t thread;
+   pthread_mutex_t lock;      //guards the hand-off queue
+   Handoff *head;
+   Handoff *tail;
+   int queued;
+   int live_matches;
+   Player *records;
+   Match *dead_matches;       //matches closed during the current batch of events
+   Uring *ring;               //set when the io_uring backend is used
+   uint64_t wakeups;
+   Conn *dirty;               //clients with output waiting to be sent
+   TimerWheel *timers;        //deadlines of this worker's matches
+   Solver *solver;            //moves for the bot seats
+   UltimateBot *ultimate_bot; //and in ultimate mode
+   Think *thoughts;           //bot moves the planners have finished, guarded by lock
+} Worker;
+
+typedef struct AcceptBatchData {
+   Uring *ring;
+   struct sockaddr_storage addr[ACCEPT_DEPTH];
+   socklen_t addr_len[ACCEPT_DEPTH];
+   int ready[ACCEPT_DEPTH];
+   int ready_head;
+   int ready_count;
+   int armed;
+} AcceptBatch;
+
+typedef struct SessionData {
+   int sock;
+   int player_index;          //-1 until the client logs in
+   long enqueued;             //CLOCK_MONOTONIC ns when it started waiting
+} Session;
+
+typedef struct LobbyStatsData {
+   long paired;               //clients that left the lobby for a match
+   long dead;                 //clients that hung up while waiting
+   long full;                 //clients turned away from a full lobby
+   long wait_total;           //ns
+   long wait_max;             //ns
+   long wait_hist[LOBBY_BUCKETS]; //bucket i: waits under 2^i microseconds
+} LobbyStats;
+
+//how well output is batched, from every worker
+typedef struct SendStatsData {
+   long messages;             //protocol messages queued
+   long sends;                //system calls (or io_uring sends) they went out in
+   long bytes;
+   long failed;               //clients whose output could not be sent
+} SendStats;
+
+typedef struct ListenerData {
+   int id;
+   int sock;
+   int backlog;
+   pthread_t thread;
+   AcceptBatch batch;         //io_uring backend only
+   long accepts;
+   long last_accepts;         //at the previous stats report
+   long max_queue;            //deepest accept queue seen
+} Listener;
+
 void dprintf(const char *fmt, ...);
 
-void load_records(char *filename, Player *records);
-void save_records(char *filename, Player * records);
+void load_records(char *filename, PlayerStore<Player> *store);
+void replay_result(int id, int kind, int value);
+int save_records();
+
+void send_record_msg(int socket, Player *record);
+
+void print_records(PlayerStore<Player> *store);
+void print_board(Board *board);
+char get_player_symbol(char player);
+int get_player_index(int id);
+void record_win(Player *records, int winner, int loser);
+void record_tie(Player *records, int player);
+void copy_record(Player *record, Player *copy);
+int send_msg(int socket, const void *msg, int len, const char *what);
+void send_game_over(int socket, char flag, Board *board);
+void send_ultimate_over(int socket, char flag, UltimateBoard *grid);
+void send_ultimate_turn_msg(int socket, UltimateBoard *grid);
+void send_match_over(Match *m, int socket, char flag);
+void send_id_msg(int socket);
+void send_record_msg(int socket, Player *record);
+void send_inv_msg(int socket, char flag);
+void send_turn_msg(int socket, Board *board);
+void send_wait_msg(int socket);
+void append_board(char msg[], char start_index, Board *board);
+void append_grid(char msg[], int start_index, UltimateBoard *grid);
+
+void reap_terminated_child(int status);              // reap subservers
+void *get_in_addr(struct sockaddr * sa);             // get internet address
+int get_server_socket(char *hostname, char *port, int reuseport); // get a server socket
+int start_server(int serv_socket, int backlog);      // start server's listening
+int accept_client(int serv_sock);                    // accept a connection from client
+int accept_client_uring(AcceptBatch *ab, int serv_sock); // accept through a batch of io_uring accepts
+void *accept_loop(void *arg);                        // accept clients on one listener
+void sample_accept_queue(Listener *l);
+void print_listener_stats(int interval);
+int read_listen_drops(long *overflows, long *drops);
+long now_ns();
+long now_tick();
+int timer_wait_ms(TimerWheel *timers);
+void lobby_join(int sock, int player_index);         // wait for an opponent
+void pair_waiting();                                 // start matches for waiting clients
+int lobby_pop_live(Session *s);
+int session_alive(int sock);
+void *matchmaker_loop(void *arg);                    // pair logged in clients by rating
+RatingIndex<Session>::Entry *try_match(RatingIndex<Session> *index, RatingIndex<Session>::Entry *e, long now);
+int player_rating(Player *p);
+void lobby_left(Session *s);
+void start_pair(int client1_sock, int client2_sock);
+void start_spawner(Player *records);                 // fork the process that forks subservers
+void spawner_loop(int sock, Player *records);
+void print_lobby_stats();
+void print_send_stats();
+void print_log_stats();
+void print_client(struct sockaddr_storage *client_addr); // print where a client connected from
+void subserver(int client1_sock, int client2_sock, Player *records); // subserver - subserver
+Task play_match(Match *m, Player *records);          // the game, as a coroutine
+Task login_client(Match *m, Player *records);        // just the login, before the lobby
+void print_ip( struct addrinfo *ai);                 // print IP info from getaddrinfo()
+
+void start_workers(int count, Player *records);     // start the event loop threads
+void dispatch_match(int client1_sock, int client2_sock, int player1_index, int player2_index); // hand a pair to the least loaded worker
+void dispatch_login(int sock);                       // have the least loaded worker log a client in
+int least_loaded_worker();
+void *worker_loop(void *arg);                        // event loop of one worker
+void worker_loop_uring(Worker *w);                   // the same loop on top of io_uring
+void worker_watch(Worker *w, Conn *c);               // start receiving from a client
+void sweep_dead_matches(Worker *w);
+int conn_queue(Conn *c, const void *msg, int len, const char *what);
+int conn_write(Conn *c);
+void conn_flush(Worker *w);
+void conn_sent(Worker *w, Conn *c, int res);
+void conn_recv(Worker *w, Conn *c);
+void bot_answer(Worker *w, Conn *c);
+int bot_think(Match *m, int seat, Board *board);
+void take_thoughts(Worker *w);
+void start_planner(int threads);
+void *planner_loop(void *arg);                       // search for queued bot moves, one at a time
+void print_planner_stats();
+int push_handoff(Worker *w, int client1_sock, int client2_sock, int player1_index, int player2_index);
+Handoff *pop_handoff(Worker *w);
+void take_handoffs(Worker *w);
+Match *match_create(Worker *w, int client1_sock, int client2_sock);
+void match_start(Match *m, Player *records);
+int match_on_input(Match *m, int seat, char *buffer, int len);
+int conn_received(Conn *c, int count);               // hand whole messages to the game
+void match_arm_turn(Match *m);                       // restart the deadline of whoever is on
+void match_timed_out(Timer *t);
+void match_close(Match *m);
+void match_free(Match *m);
+
+PlayerStore<Player> players; //the records file, mapped
+RecordLog record_log; //every result since the last checkpoint, replayed over the records file at startup
+int log_window = LOG_WINDOW_MS;
+int checkpoint_interval = CHECKPOINT_S;
+
+int debug = 0; //global variable to determine whether or not server is being run in "debug mode"
+int event_mode = 0; //set when matches are run by worker threads instead of forked subservers
+int uring_mode = 0; //set when workers use io_uring instead of epoll
+int num_workers = 0;
+Worker *workers = NULL;
+Conn **fd_conns = NULL; //which client owns each socket, so output can be queued
+int max_fds = 0;
+int num_listeners = 1;
+Listener *listeners = NULL;
+long listen_overflows_base = 0; //the kernel's counts at startup
+long listen_drops_base = 0;
+MpmcQueue<Session> *lobby = NULL; //clients waiting for an opponent, from any listener
+LobbyStats lobby_stats;
+SendStats send_stats;
+int matcher_wakefd = -1;
+long matcher_waiting = 0;
+pthread_t matcher_thread;
+int spawner_sock = -1; //pairs go to the spawner over this, when forking subservers
+long matches_played = 0;
+int turn_timeout = TURN_TIMEOUT;
+int match_timeout = MATCH_TIMEOUT;
+int bot_wait = BOT_WAIT;
+int game_mode = GAME_CLASSIC;
+int bot_think_ms = 0; //per bot move with Monte Carlo search, 0 to use the solver
+int bot_threads = 0;
+Tablebase tablebase; //the bot's moves, looked up instead of searched for when one is loaded
+
+//the planners: as many searches at once as there are, each spread over bot_threads
+Planner *planners = NULL;
+int num_planners = 0;
+pthread_mutex_t planner_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t planner_ready = PTHREAD_COND_INITIALIZER;
+Think *planner_head = NULL;
+Think *planner_tail = NULL;
+int planner_queued = 0; //guarded by planner_lock
+PlannerStats planner_stats;
+
+int main(int argc, char *argv[]) {
+	int backlog = BACKLOG;
+	int stats_interval = 0;
+	struct rlimit limit;
+	char log_file[4096];
+	long replayed;
+	int i;
+
+	char *tablebase_file = NULL;
+
+	Player *records;
+
+	for(i = 2; i < argc; i = i + 1) {
+		if(strcmp("-d", argv[i]) == 0) {
+			printf("Running in debug mode.\n");
+			debug = 1;
+		} else if(strcmp("-e", argv[i]) == 0) {
+			printf("Running in event loop mode.\n");
+			event_mode = 1;
+		} else if(strcmp("-u", argv[i]) == 0) {
+			printf("Running in event loop mode with io_uring.\n");
+			event_mode = 1;
+			uring_mode = 1;
+		} else if(strcmp("-w", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			num_workers = atoi(argv[i]);
+		} else if(strcmp("-l", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			num_listeners = atoi(argv[i]);
+		} else if(strcmp("-b", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			backlog = atoi(argv[i]);
+		} else if(strcmp("-s", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			stats_interval = atoi(argv[i]);
+		} else if(strcmp("-t", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			turn_timeout = atoi(argv[i]);
+		} else if(strcmp("-m", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			match_timeout = atoi(argv[i]);
+		} else if(strcmp("-a", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			bot_wait = atoi(argv[i]);
+		} else if(strcmp("-M", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			bot_think_ms = atoi(argv[i]);
+		} else if(strcmp("-p", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			bot_threads = atoi(argv[i]);
+		} else if(strcmp("-g", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			if(strcmp("ultimate", argv[i]) == 0) {
+				printf("Playing ultimate tic-tac-toe.\n");
+				game_mode = GAME_ULTIMATE;
+			} else if(strcmp("classic", argv[i]) != 0) {
+				printf("Unknown game %s: classic or ultimate.\n", argv[i]);
+				exit(1);
+			}
+		} else if(strcmp("-T", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			tablebase_file = argv[i];
+		} else if(strcmp("-f", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			log_window = atoi(argv[i]);
+		} else if(strcmp("-c", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			checkpoint_interval = atoi(argv[i]);
+		}
+	}
+	if(num_listeners < 1) {
+		num_listeners = 1;
+	}
+	lobby = new MpmcQueue<Session>(LOBBY_SIZE);
+
+	getrlimit(RLIMIT_NOFILE, &limit);
+	max_fds = limit.rlim_cur;
+	fd_conns = (Conn **)calloc(max_fds, sizeof(Conn *));
+	if(fd_conns == NULL) {
+		printf("Out of memory for connections.\n");
+		exit(1);
+	}
+	
+	load_records(argv[1], &players);
+	records = players;
+
+	//results since the last checkpoint may not all have reached the file
+	snprintf(log_file, sizeof(log_file), "%s.log", argv[1]);
+	if((replayed = record_log.open(log_file, players.id(), replay_result)) == -1) {
+		printf("Unable to use log %s: %s\n", log_file, strerror(errno));
+		exit(1);
+	}
+	printf("Replayed %ld results from %s.\n", replayed, log_file);
+
+	if(tablebase_file != NULL) {
+		errno = 0;
+		if(tablebase.open(tablebase_file) == -1) {
+			printf("Unable to use tablebase %s: %s\n", tablebase_file,
+			       errno != 0 ? strerror(errno) : "not a tablebase of this version");
+			exit(1);
+		}
+		dprintf("Mapped %u positions from tablebase %s.\n", tablebase.count(), tablebase_file);
+	}
+
+	print_records(&players);
+
+	signal(SIGCHLD, reap_terminated_child);
+
+	//subservers are forked by a process of their own, made while this is one thread
+	if(!event_mode) {
+		start_spawner(records);
+	}
+
+	if(record_log.start(log_window, checkpoint_interval, save_records) == -1) {
+		printf("Unable to use log %s: %s\n", log_file, strerror(errno));
+		exit(1);
+	}
+
+	//set up the server
+	dprintf("Initializing server.\n");
+	read_listen_drops(&listen_overflows_base, &listen_drops_base);
+	listeners = (Listener *)calloc(num_listeners, sizeof(Listener));
+	if(listeners == NULL) {
+		printf("Out of memory for listeners.\n");
+		exit(1);
+	}
+	for(i = 0; i < num_listeners; i = i + 1) {
+		//with more than one listener the kernel spreads connections over them
+		listeners[i].id = i;
+		listeners[i].backlog = backlog;
+		listeners[i].sock = get_server_socket(HOST, HTTPPORT, num_listeners > 1);
+	
+		if(start_server(listeners[i].sock, backlog) == -1) {
+			printf("Error starting server: %s.\n", strerror(errno));
+			exit(1);
+		}
+	}
+
+	if(event_mode) {
+		if(num_workers <= 0) {
+			num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		start_workers(num_workers, records);
+		if(bot_think_ms > 0) {
+			start_planner(bot_threads);
+		}
+
+		if((matcher_wakefd = eventfd(0, EFD_NONBLOCK)) == -1 ||
+		   pthread_create(&matcher_thread, NULL, matchmaker_loop, records) != 0) {
+			printf("Unable to start the matchmaker.\n");
+			exit(1);
+		}
+	}
+
+	for(i = 0; i < num_listeners; i = i + 1) {
+		if(uring_mode) {
+			listeners[i].batch.ring = new Uring(ACCEPT_DEPTH * 2);
+		}
+		if(pthread_create(&listeners[i].thread, NULL, accept_loop, &listeners[i]) != 0) {
+			printf("Unable to start listener %d.\n", i);
+			exit(1);
+		}
+	}
+
+	while(1) {
+		if(stats_interval > 0) {
+			sleep(stats_interval);
+			print_listener_stats(stats_interval);
+			print_lobby_stats();
+			print_send_stats();
+			print_log_stats();
+			if(planners != NULL) {
+				print_planner_stats();
+			}
+		} else {
+			pause();
+		}
+	}
+
+	save_records();
+
+	exit(0);
+}
+
+/*
+*	Accepts clients on one listening socket and puts them in the lobby to
+*	wait for an opponent. Each listener runs this in its own thread.
+*/
+void *accept_loop(void *arg) {
+	Listener *l = (Listener *)arg;
+	int sock;
+
+	while(1) {
+		if(l->batch.ring != NULL) {
+			sock = accept_client_uring(&l->batch, l->sock);
+		} else {
+			sock = accept_client(l->sock);
+		}
+		if(sock == -1) {
+			continue;
+		}
+		__atomic_add_fetch(&l->accepts, 1, __ATOMIC_RELAXED);
+		sample_accept_queue(l);
+
+		dprintf("Received connection from a client.\n");
+
+		char msg = P_WAIT; //tell the client just to wait
+		if(send(sock, &msg, sizeof(msg), MSG_NOSIGNAL) < 0) {
+			printf("Unable to send: %s\n", strerror(errno));
+			close(sock);
+			continue;
+		}
+
+		if(event_mode) {
+			//clients log in first so they can be matched by rating
+			dispatch_login(sock);
+		} else {
+			lobby_join(sock, -1);
+		}
+	}
+
+	return NULL;
+}
+
+long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+long now_tick() {
+	return now_ns() / (TIMER_TICK_MS * 1000000L);
+}
+
+/*
+*	How long an event loop can sleep before its next timer is due, in
+*	milliseconds, or -1 if it has none armed
+*/
+int timer_wait_ms(TimerWheel *timers) {
+	long next = timers->next_expiry();
+	long wait;
+
+	if(next == -1) {
+		return -1;
+	}
+	wait = (next * TIMER_TICK_MS * 1000000L - now_ns() + 999999) / 1000000;
+	return wait > 0 ? wait : 0;
+}
+
+/*
+*	Queues a client in the lobby and gets someone to pair it: the matchmaker
+*	in event loop mode, or this listener thread itself when forking subservers.
+*/
+void lobby_join(int sock, int player_index) {
+	Session s;
+	uint64_t one = 1;
+
+	s.sock = sock;
+	s.player_index = player_index;
+	s.enqueued = now_ns();
+	if(!lobby->push(s)) {
+		printf("Lobby is full, turning a client away.\n");
+		__atomic_add_fetch(&lobby_stats.full, 1, __ATOMIC_RELAXED);
+		close(sock);
+		return;
+	}
+
+	if(event_mode) {
+		write(matcher_wakefd, &one, sizeof(one));
+	} else {
+		pair_waiting();
+	}
+}
+
+/*
+*	Pops waiting clients two at a time and starts a match for each pair, in
+*	the order they arrived. Clients that hung up while waiting are dropped.
+*	Any number of threads may run this at once.
+*/
+void pair_waiting() {
+	Session a, b;
+
+	while(lobby->size() >= 2) {
+		if(!lobby_pop_live(&a)) {
+			break;
+		}
+		if(!lobby_pop_live(&b)) {
+			//another thread took the rest; whoever queues last pairs this one
+			if(!lobby->push(a)) {
+				close(a.sock);
+			}
+			continue;
+		}
+
+		lobby_left(&a);
+		lobby_left(&b);
+		start_pair(a.sock, b.sock);
+	}
+}
+
+/*
+*	Pops the next waiting client that is still connected
+*/
+int lobby_pop_live(Session *s) {
+	while(lobby->pop(*s)) {
+		if(session_alive(s->sock)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+*	Checks that a waiting client is still there, closing it if not
+*/
+int session_alive(int sock) {
+	char c;
+	int n;
+
+	//a waiting client never talks, so end of file or an error means it left
+	n = recv(sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	if(n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+		dprintf("Client left the lobby.\n");
+		__atomic_add_fetch(&lobby_stats.dead, 1, __ATOMIC_RELAXED);
+		close(sock);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+*	Records how long a client waited in the lobby
+*/
+void lobby_left(Session *s) {
+	long wait = now_ns() - s->enqueued;
+	long max = __atomic_load_n(&lobby_stats.wait_max, __ATOMIC_RELAXED);
+	int bucket = 0;
+
+	__atomic_add_fetch(&lobby_stats.paired, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&lobby_stats.wait_total, wait, __ATOMIC_RELAXED);
+	while(wait > max && !__atomic_compare_exchange_n(&lobby_stats.wait_max, &max, wait, 1,
+	                                                 __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	//bucket i holds waits under 2^i microseconds
+	while(bucket < LOBBY_BUCKETS - 1 && (wait / 1000) >= (1L << bucket)) {
+		bucket = bucket + 1;
+	}
+	__atomic_add_fetch(&lobby_stats.wait_hist[bucket], 1, __ATOMIC_RELAXED);
+}
+
+/*
+*	Starts a match for two paired clients: hands them to a worker, or to the
+*	spawner to fork a subserver for
+*/
+void start_pair(int client1_sock, int client2_sock) {
+	union {
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	int fds[2] = {client1_sock, client2_sock};
+	char byte = 0;
+
+	if(event_mode) {
+		//the worker owns both sockets from now on
+		dispatch_match(client1_sock, client2_sock, -1, -1);
+		return;
+	}
+
+	//the sockets go over with the message; one message is one pair, whichever listener sends it
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = &byte;
+	iov.iov_len = 1;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control.buf;
+	mh.msg_controllen = sizeof(control.buf);
+	cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+	if(sendmsg(spawner_sock, &mh, MSG_NOSIGNAL) == -1) {
+		printf("Unable to start a match: %s\n", strerror(errno));
+	}
+
+	//the spawner has its own copies now
+	close(client1_sock);
+	close(client2_sock);
+}
+
+/*
+*	Forks the spawner, which forks a subserver for every pair the listeners
+*	send it. Call it while the server is still one thread: a child gets only
+*	the thread that forked it, so a stdio or malloc lock another thread held
+*	at the time stays held in the child for good. The spawner never starts a
+*	thread, so neither do the subservers it forks.
+*/
+void start_spawner(Player *records) {
+	int sv[2];
+
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+		printf("Unable to start the spawner: %s\n", strerror(errno));
+		exit(1);
+	}
+	fflush(stdout);
+	switch(fork()) {
+	case -1:
+		printf("Unable to start the spawner: %s\n", strerror(errno));
+		exit(1);
+	case 0:
+		close(sv[0]);
+		spawner_loop(sv[1], records); //never returns
+		break;
+	default:
+		close(sv[1]);
+		spawner_sock = sv[0];
+	}
+}
+
+/*
+*	Receives pairs of clients and forks a subserver for each, until the
+*	server goes away
+*/
+void spawner_loop(int sock, Player *records) {
+	union {
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	int fds[2];
+	char byte;
+	int n;
+
+	while(1) {
+		memset(&mh, 0, sizeof(mh));
+		iov.iov_base = &byte;
+		iov.iov_len = 1;
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = control.buf;
+		mh.msg_controllen = sizeof(control.buf);
+
+		n = recvmsg(sock, &mh, 0);
+		if(n == -1 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			exit(0); //the server is gone
+		}
+		cm = CMSG_FIRSTHDR(&mh);
+		if(cm == NULL || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(fds))) {
+			continue;
+		}
+		memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+
+		//fork for subserver
+		if(!fork()) { // child process, so start the subserver
+			close(sock);
+			dprintf("Preparing to play.\n");
+			subserver(fds[0], fds[1], records);
+		}
+
+		//parent process: reset client sockets for more connections
+		close(fds[0]);
+		close(fds[1]);
+	}
+}
+
+/*
+*	Prints how many clients left the lobby and how long they waited there
+*/
+void print_lobby_stats() {
+	long paired = __atomic_load_n(&lobby_stats.paired, __ATOMIC_RELAXED);
+	long seen = 0;
+	long p50 = -1;
+	long p99 = -1;
+	int i;
+
+	for(i = 0; i < LOBBY_BUCKETS && paired > 0; i = i + 1) {
+		seen = seen + __atomic_load_n(&lobby_stats.wait_hist[i], __ATOMIC_RELAXED);
+		if(p50 == -1 && seen * 2 >= paired) {
+			p50 = 1L << i;
+		}
+		if(p99 == -1 && seen * 100 >= paired * 99) {
+			p99 = 1L << i;
+		}
+	}
+
+	printf("lobby: %ld waiting, %ld paired, %ld left early, %ld turned away; "
+	       "wait avg %ldus, p50 <%ldus, p99 <%ldus, max %ldus\n",
+	       (long)lobby->size() + __atomic_load_n(&matcher_waiting, __ATOMIC_RELAXED), paired,
+	       __atomic_load_n(&lobby_stats.dead, __ATOMIC_RELAXED),
+	       __atomic_load_n(&lobby_stats.full, __ATOMIC_RELAXED),
+	       paired > 0 ? __atomic_load_n(&lobby_stats.wait_total, __ATOMIC_RELAXED) / paired / 1000 : 0,
+	       p50, p99, __atomic_load_n(&lobby_stats.wait_max, __ATOMIC_RELAXED) / 1000);
+	fflush(stdout);
+}
+
+/*
+*	Prints how many protocol messages went out in how many sends
+*/
+void print_send_stats() {
+	long messages = __atomic_load_n(&send_stats.messages, __ATOMIC_RELAXED);
+	long sends = __atomic_load_n(&send_stats.sends, __ATOMIC_RELAXED);
+
+	printf("output: %ld messages in %ld sends, %ld saved, %ld bytes, %ld clients failed\n",
+	       messages, sends, messages - sends, __atomic_load_n(&send_stats.bytes, __ATOMIC_RELAXED),
+	       __atomic_load_n(&send_stats.failed, __ATOMIC_RELAXED));
+	fflush(stdout);
+}
+
+void print_log_stats() {
+	long committed = record_log.committed();
+	long syncs = record_log.syncs();
+
+	printf("log: %ld results in %ld syncs, %.1f a sync, %ld dropped, %ld checkpoints\n", committed, syncs,
+	       syncs > 0 ? (double)committed / syncs : 0.0, record_log.dropped(), record_log.checkpoints());
+	fflush(stdout);
+}
+
+/*
+*	Pairs logged in players by rating. New arrivals are matched against
+*	everyone waiting as soon as they come in; every MATCH_TICK_MS the whole
+*	index is walked again, oldest first, since each player's window widens
+*	the longer they wait.
+*/
+void *matchmaker_loop(void *arg) {
+	Player *records = (Player *)arg;
+	RatingIndex<Session> index(RATING_MAX, RATING_BUCKET);
+	RatingIndex<Session>::Entry *e;
+	struct pollfd pfd;
+	uint64_t wakeups;
+	Session s;
+	Player record;
+	long now;
+	long next_sweep = 0;
+
+	pfd.fd = matcher_wakefd;
+	pfd.events = POLLIN;
+
+	while(1) {
+		poll(&pfd, 1, MATCH_TICK_MS);
+		if(pfd.revents & POLLIN) {
+			read(matcher_wakefd, &wakeups, sizeof(wakeups));
+		}
+		now = now_ns();
+
+		while(lobby->pop(s)) {
+			e = new RatingIndex<Session>::Entry();
+			e->value = s;
+			copy_record(&records[s.player_index], &record);
+			e->rating = player_rating(&record);
+			e->since = s.enqueued;
+			index.insert(e);
+			try_match(&index, e, now);
+		}
+
+		if(now >= next_sweep) {
+			e = index.oldest();
+			while(e != NULL) {
+				e = try_match(&index, e, now);
+			}
+			next_sweep = now + MATCH_TICK_MS * 1000000L;
+		}
+
+		__atomic_store_n(&matcher_waiting, index.size(), __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+/*
+*	Pairs e with the closest rated player inside its window, if there is
+*	one, or with the bot seat once e has waited bot_wait seconds. Returns
+*	the entry after e by arrival, for walking the index.
+*/
+RatingIndex<Session>::Entry *try_match(RatingIndex<Session> *index, RatingIndex<Session>::Entry *e, long now) {
+	RatingIndex<Session>::Entry *m, *next;
+	long window = MATCH_WINDOW + MATCH_WINDOW_GROWTH * ((now - e->since) / 1000000000L);
+
+	while((m = index->best_match(e, window)) != NULL) {
+		//only check that clients are still there once there is a match for them
+		if(!session_alive(m->value.sock)) {
+			index->remove(m);
+			delete m;
+			continue;
+		}
+
+		next = e->newer;
+		if(!session_alive(e->value.sock)) {
+			index->remove(e);
+			delete e;
+			return next;
+		}
+		if(next == m) {
+			next = m->newer;
+		}
+
+		index->remove(e);
+		index->remove(m);
+		lobby_left(&e->value);
+		lobby_left(&m->value);
+		dprintf("Matched ratings %d and %d.\n", e->rating, m->rating);
+		if(m->since < e->since) {
+			//whoever waited longer moves first
+			dispatch_match(m->value.sock, e->value.sock, m->value.player_index, e->value.player_index);
+		} else {
+			dispatch_match(e->value.sock, m->value.sock, e->value.player_index, m->value.player_index);
+		}
+		delete e;
+		delete m;
+		return next;
+	}
+
+	if(bot_wait > 0 && now - e->since >= bot_wait * 1000000000L) {
+		next = e->newer;
+		index->remove(e);
+		if(session_alive(e->value.sock)) {
+			lobby_left(&e->value);
+			dprintf("No opponent for rating %d, giving it the bot.\n", e->rating);
+			dispatch_match(e->value.sock, BOT_SEAT, e->value.player_index, BOT_PLAYER);
+		}
+		delete e;
+		return next;
+	}
+
+	return e->newer;
+}
+
+/*
+*	A rating derived from a player's record: 1500 for a new player, moving
+*	towards 2500 or 500 as wins or losses pile up
+*/
+int player_rating(Player *p) {
+	int games = p->wins + p->losses + p->ties;
+	return 1500 + 1000 * (p->wins - p->losses) / (games + 10);
+}
+
+/*
+*	Notes how long a listener's accept queue is, for the deepest seen. The
+*	listener's thread and the stats report both sample it.
+*/
+void sample_accept_queue(Listener *l) {
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
+	long max = __atomic_load_n(&l->max_queue, __ATOMIC_RELAXED);
+
+	if(getsockopt(l->sock, IPPROTO_TCP, TCP_INFO, &info, &len) == -1) {
+		return;
+	}
+
+	//for a listening socket this is the queue length
+	while((long)info.tcpi_unacked > max && !__atomic_compare_exchange_n(&l->max_queue, &max,
+	                                        (long)info.tcpi_unacked, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+*	Prints each listener's accept rate and deepest accept queue, then the
+*	connections the kernel turned away since startup because an accept
+*	queue was full. The kernel only counts those for the whole host, so they
+*	cover every listening socket on it, not only this server's.
+*/
+void print_listener_stats(int interval) {
+	Listener *l;
+	long accepts, overflows, drops;
+	int i;
+
+	for(i = 0; i < num_listeners; i = i + 1) {
+		l = &listeners[i];
+		sample_accept_queue(l);
+
+		accepts = __atomic_load_n(&l->accepts, __ATOMIC_RELAXED);
+		printf("listener %d: %ld accepts, %.1f/s, queue max %ld of %d\n",
+		       l->id, accepts, (double)(accepts - l->last_accepts) / interval,
+		       __atomic_load_n(&l->max_queue, __ATOMIC_RELAXED), l->backlog);
+		l->last_accepts = accepts;
+	}
+	if(read_listen_drops(&overflows, &drops) == 0) {
+		printf("listen queues (whole host): %ld overflows, %ld connections dropped\n",
+		       overflows - listen_overflows_base, drops - listen_drops_base);
+	}
+	fflush(stdout);
+}
+
+/*
+*	Reads the kernel's ListenOverflows and ListenDrops counters from
+*	/proc/net/netstat, where a line of TcpExt names is followed by a line of
+*	their values. Returns 0, or -1 if they cannot be read.
+*/
+int read_listen_drops(long *overflows, long *drops) {
+	FILE *f = fopen("/proc/net/netstat", "r");
+	char names[8192], values[8192];
+	char *name, *value, *name_save, *value_save;
+	int found = 0;
+
+	if(f == NULL) {
+		return -1;
+	}
+	while(found < 2 && fgets(names, sizeof(names), f) != NULL && fgets(values, sizeof(values), f) != NULL) {
+		if(strncmp(names, "TcpExt:", 7) != 0) {
+			continue;
+		}
+		name = strtok_r(names, " \n", &name_save);
+		value = strtok_r(values, " \n", &value_save);
+		while(name != NULL && value != NULL) {
+			if(strcmp(name, "ListenOverflows") == 0) {
+				*overflows = atol(value);
+				found = found + 1;
+			} else if(strcmp(name, "ListenDrops") == 0) {
+				*drops = atol(value);
+				found = found + 1;
+			}
+			name = strtok_r(NULL, " \n", &name_save);
+			value = strtok_r(NULL, " \n", &value_save);
+		}
+	}
+	fclose(f);
+	return found == 2 ? 0 : -1;
+}
+
+/*
+*	Maps the records file into the store. A file of bare records, as older
+*	servers wrote, is converted first; a file that cannot be used stops the
+*	server rather than letting it start with no records.
+*/
+void load_records(char *filename, PlayerStore<Player> *store) {
+	long converted = store->open(filename, MAX_PLAYERS);
+
+	if(converted == -1) {
+		printf("Unable to use records file %s: %s\n", filename,
+		       errno == EINVAL ? "not a records file of this version" : strerror(errno));
+		exit(1);
+	}
+	if(converted > 0) {
+		printf("Converted %ld records in %s to the mapped layout.\n", converted, filename);
+	}
+}
+
+/*
+*	Brings a counter up to a logged value. The page holding it may have
+*	reached the file after the entry was logged, so a counter already there
+*	or past it is left alone.
+*/
+void replay_result(int id, int kind, int value) {
+	Player *records = players;
+	int index = players.find(id);
+	int *counter;
+
+	if(index < 0) {
+		return;
+	}
+	if(kind == LOG_WIN) {
+		counter = &records[index].wins;
+	} else if(kind == LOG_LOSS) {
+		counter = &records[index].losses;
+	} else if(kind == LOG_TIE) {
+		counter = &records[index].ties;
+	} else {
+		return;
+	}
+	if(*counter < value) {
+		*counter = value;
+	}
+}
+
+/*
+*	Checkpoints the records file: only pages changed since the last one
+*	are written. Returns 0, or -1.
+*/
+int save_records() {
+	return players.checkpoint();
+}
+
+
+/*
+*	Lists every record in debug mode; otherwise just how many there are
+*/
+void print_records(PlayerStore<Player> *store) {
+	Player *records = *store;
+	long i;
+	for(i = 0; debug && i < store->count(); i = i + 1) {
+		printf("Player: id = %d, first name = %s, last name = %s\n", records[i].playerID, records[i].firstName, records[i].lastName);
+	}
+	printf("%ld players loaded, index of %ld slots.\n", store->count(), store->index_slots());
+}
+
+/*
+*	Where child processes will communicate with clients and run the game.
+*	The game itself is play_match(); the subserver just blocks on whichever
+*	client the match is waiting for and hands it the message, or tells the
+*	game when that client's time is up.
+*/
+void subserver(int client1_sock, int client2_sock, Player *records) {
+	Match *m = match_create(NULL, client1_sock, client2_sock);
+	TimerWheel timers(now_tick());
+	struct pollfd pfd;
+	struct iovec iov[2];
+	Conn *c;
+
+	//networking data
+	int read_count = -1;
+
+	m->timers = &timers;
+	fd_conns[client1_sock] = &m->conn[0];
+	fd_conns[client2_sock] = &m->conn[1];
+	match_start(m, records);
+
+	while(!m->task.done()) {
+		//send everything the game said since it last waited
+		if(conn_write(&m->conn[0]) == -1 || conn_write(&m->conn[1]) == -1) {
+			break;
+		}
+		c = &m->conn[m->inbox.waiting_for()];
+
+		//wait for the client, but no longer than its deadline
+		pfd.fd = c->sock;
+		pfd.events = POLLIN;
+		if(poll(&pfd, 1, timer_wait_ms(&timers)) <= 0) {
+			timers.advance(now_tick());
+			continue;
+		}
+
+		//get user input from client, as much of it as has arrived
+		read_count = readv(c->sock, iov, c->in.space(iov));
+		if(read_count <= 0) {
+			dprintf("Client left the game.\n");
+			break;
+		}
+
+		conn_received(c, read_count);
+	}
+
+	//goodbye
+	conn_write(&m->conn[0]);
+	conn_write(&m->conn[1]);
+	close(client1_sock);
+	close(client2_sock);
+
+	exit(0);
+}
+
+/*
+*	The game: login, the turn loop and game over. It suspends whenever it
+*	needs a message from a client and is resumed by match_on_input(), so the
+*	same flow runs in a forked subserver and on the epoll and io_uring workers.
+*	An empty message means the client it was waiting for ran out of time.
+*/
+Task play_match(Match *m, Player *records) {
+
+	//these will be used to control whose turn it is
+	int current_sock;
+	int waiting_sock;
+	int client1_sock = m->conn[0].sock;
+	int client2_sock = m->conn[1].sock;
+
+	//game data
+	Outcome outcome = IN_PLAY;
+	char x, y;
+	int i, sub, sq, check;
+
+	Inbox::Message msg;
+	char *buffer;
+
+	//get players to "login", unless the matchmaker already had them do it
+	int t_id = 0;
+	if(m->player_index[0] == -1) {
+		dprintf("Getting player 1 user id...\n");
+		while(m->player_index[0] == -1) {
+			send_id_msg(client1_sock);
+
+			//get user input from client
+			msg = co_await m->inbox.recv(0);
+			buffer = msg.data;
+			if(buffer == NULL) {
+				dprintf("Player 1 never logged in.\n");
+				co_return;
+			}
+
+			//anything but an id is turned down, and the id asked for again
+			if(buffer[0] != P_UID || msg.len < P_UID_REPLY_LEN) {
+				dprintf("Input error: expected a user id\n");
+				continue;
+			}
+
+			t_id = buffer[1];
+			m->player_index[0] = get_player_index(t_id);
+		}
+		send_record_msg(client1_sock, &records[m->player_index[0]]);
+	}
+	
+	t_id = 0;
+	if(m->player_index[1] == -1) {
+		dprintf("Getting player 2 user id...\n");
+		while(m->player_index[1] == -1) {
+			send_id_msg(client2_sock);
+
+			//get user input from client
+			msg = co_await m->inbox.recv(1);
+			buffer = msg.data;
+			if(buffer == NULL) {
+				dprintf("Player 2 never logged in.\n");
+				co_return;
+			}
+
+			//anything but an id is turned down, and the id asked for again
+			if(buffer[0] != P_UID || msg.len < P_UID_REPLY_LEN) {
+				dprintf("Input error: expected a user id\n");
+				continue;
+			}
+
+			t_id = buffer[1];
+			m->player_index[1] = get_player_index(t_id);
+		}
+		send_record_msg(client2_sock, &records[m->player_index[1]]);
+	}
+	//both players are now logged in
+	
+	//start from an empty board
+	dprintf("Preparing game board...\n");
+	m->board.clear();
+	m->ultimate.clear();
+
+	//let the game begin!
+	while(outcome == IN_PLAY) {
+		
+		//set up "reply" sockets based on whose turn it is
+		if(m->turn == 1) {
+			current_sock = client1_sock;
+			waiting_sock = client2_sock;
+		} else {
+			current_sock = client2_sock;
+			waiting_sock = client1_sock;
+		}
+
+		//tell idle player to wait
+		send_wait_msg(waiting_sock);
+		//alert current player it's her turn
+		if(game_mode == GAME_ULTIMATE) {
+			send_ultimate_turn_msg(current_sock, &m->ultimate);
+		} else {
+			send_turn_msg(current_sock, &m->board);
+		}
+
+		//get user input from client
+		msg = co_await m->inbox.recv(m->turn - 1);
+		buffer = msg.data;
+
+		if(buffer == NULL) {
+			//out of time, so the player to move forfeits
+			dprintf("Game over. Player %d forfeits!", m->turn);
+
+			record_win(records, m->player_index[2 - m->turn], m->player_index[m->turn - 1]);
+
+			send_match_over(m, waiting_sock, Q_YOU_WON);
+			send_match_over(m, current_sock, Q_YOU_LOST);
+			dprintf("Matches played: %ld\n", __atomic_add_fetch(&matches_played, 1, __ATOMIC_RELAXED));
+			co_return;
+		}
+
+		//anything but a move is turned down, and the same player asked again
+		if(buffer[0] != P_MOVE || msg.len < P_MOVE_LEN) {
+			dprintf("Input error: expected a move\n");
+			continue;
+		}
+
+		x = buffer[1];
+		y = buffer[2];
+		
+		dprintf("Player input: %d %d\n", x, y);
+		
+		if(game_mode == GAME_ULTIMATE) {
+			//a row and column of the whole grid
+			if(x < 0 || x > 8 || y < 0 || y > 8) {
+				dprintf("Input error: out of range\n");
+				send_inv_msg(current_sock, Q_OUT_OF_RANGE);
+				continue;
+			}
+			sub = UltimateBoard::sub_of(x, y);
+			sq = UltimateBoard::square_of(x, y);
+			if(m->ultimate.taken(sub, sq)) {
+				dprintf("Input error: location taken\n");
+				send_inv_msg(current_sock, Q_LOC_TAKEN);
+				continue;
+			} else if(!m->ultimate.allowed(sub)) {
+				dprintf("Input error: wrong board\n");
+				send_inv_msg(current_sock, Q_WRONG_BOARD);
+				continue;
+			}
+
+			//the grid works out the game's state from the one board the move is on
+			outcome = m->ultimate.play(sub, sq, get_player_symbol(m->turn));
+		} else {
+			//first, make sure the input is valid
+			check = m->board.check_move(x, y);
+			if(check == Board::MOVE_OUT_OF_RANGE) {
+				dprintf("Input error: out of range\n");
+				send_inv_msg(current_sock, Q_OUT_OF_RANGE);
+				continue;
+			} else if(check == Board::MOVE_TAKEN) {
+				dprintf("Input error: location taken\n");
+				send_inv_msg(current_sock, Q_LOC_TAKEN);
+				continue;
+			}
+
+			//update the board
+			m->board.play(3*x + y, get_player_symbol(m->turn));
+
+			if(debug > 0) {
+				print_board(&m->board);
+			}
+
+			//one table load says whether that ended the game, and how
+			outcome = OUTCOMES.status(m->board);
+		}
+		if(outcome == X_WINS || outcome == O_WINS) {
+			if(outcome == X_WINS) {
+				dprintf("Game over. Player 1 wins!");
+
+				record_win(records, m->player_index[0], m->player_index[1]);
+
+				send_match_over(m, client1_sock, Q_YOU_WON);
+				send_match_over(m, client2_sock, Q_YOU_LOST);
+			} else {
+				dprintf("Game over. Player 2 wins!");
+
+				record_win(records, m->player_index[1], m->player_index[0]);
+
+				send_match_over(m, client2_sock, Q_YOU_WON);
+				send_match_over(m, client1_sock, Q_YOU_LOST);
+			}
+			dprintf("Matches played: %ld\n", __atomic_add_fetch(&matches_played, 1, __ATOMIC_RELAXED));
+			co_return;
+		}
+
+		//prepare for next turn
+		if(m->turn == 1) {
+			m->turn = 2;
+		} else {
+			m->turn = 1;
+		}
+	}
+	
+	//if we make it this far, the game was a draw
+	send_match_over(m, client1_sock, Q_GAME_DRAW);
+	send_match_over(m, client2_sock, Q_GAME_DRAW);
+
+	for(i = 0; i < 2; i = i + 1) {
+		record_tie(records, m->player_index[i]);
+	}
+
+	dprintf("Matches played: %ld\n", __atomic_add_fetch(&matches_played, 1, __ATOMIC_RELAXED));
+}
+
+/*
+*	Counts a win and a loss. The bot seat has no record to count them in.
+*	Each count is one atomic add on the shared record, so matches finishing
+*	in any number of subservers and workers never wait on each other, and
+*	is queued for the log with the counter's new value; it is on disk within
+*	the log window, without the match waiting for it.
+*/
+void record_win(Player *records, int winner, int loser) {
+	if(winner >= 0) {
+		record_log.append(records[winner].playerID, LOG_WIN,
+		                  __atomic_add_fetch(&records[winner].wins, 1, __ATOMIC_RELAXED));
+	}
+	if(loser >= 0) {
+		record_log.append(records[loser].playerID, LOG_LOSS,
+		                  __atomic_add_fetch(&records[loser].losses, 1, __ATOMIC_RELAXED));
+	}
+}
+
+void record_tie(Player *records, int player) {
+	if(player >= 0) {
+		record_log.append(records[player].playerID, LOG_TIE,
+		                  __atomic_add_fetch(&records[player].ties, 1, __ATOMIC_RELAXED));
+	}
+}
+
+/*
+*	Copies a record for a message or a rating. The id and names never change
+*	once a record is added, so they are copied as they are; the counters are
+*	read atomically.
+*/
+void copy_record(Player *record, Player *copy) {
+	copy->playerID = record->playerID;
+	memcpy(copy->firstName, record->firstName, sizeof(copy->firstName));
+	memcpy(copy->lastName, record->lastName, sizeof(copy->lastName));
+	copy->wins = __atomic_load_n(&record->wins, __ATOMIC_RELAXED);
+	copy->losses = __atomic_load_n(&record->losses, __ATOMIC_RELAXED);
+	copy->ties = __atomic_load_n(&record->ties, __ATOMIC_RELAXED);
+}
+
+/*
+*	Logs in a lone client for the matchmaker, which needs its record to
+*	rate it. Once it is done the worker passes the client on to the lobby.
+*/
+Task login_client(Match *m, Player *records) {
+	Inbox::Message msg;
+	int t_id;
+
+	dprintf("Getting user id for the lobby...\n");
+	while(m->player_index[0] == -1) {
+		send_id_msg(m->conn[0].sock);
+
+		msg = co_await m->inbox.recv(0);
+		if(msg.data == NULL) {
+			dprintf("Client never logged in.\n");
+			co_return;
+		}
+
+		//anything but an id is turned down, and the id asked for again
+		if(msg.data[0] != P_UID || msg.len < P_UID_REPLY_LEN) {
+			dprintf("Input error: expected a user id\n");
+			continue;
+		}
+
+		t_id = msg.data[1];
+		m->player_index[0] = get_player_index(t_id);
+	}
+	send_record_msg(m->conn[0].sock, &records[m->player_index[0]]);
+
+	m->handed_off = 1;
+	co_return;
+}
+
+/*
+*	Starts one event loop thread per worker, each pinned to its own core.
+*	Every worker watches its clients' sockets with its own epoll instance and
+*	runs each match's play_match() coroutine, resuming it through
+*	match_on_input() as its clients' messages arrive.
+*/
+void start_workers(int count, Player *records) {
+	struct epoll_event ev;
+	cpu_set_t cpus;
+	int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int i;
+
+	//a client that disconnects must not take the whole server with it
+	signal(SIGPIPE, SIG_IGN);
+
+	workers = (Worker *)calloc(count, sizeof(Worker));
+	if(workers == NULL) {
+		printf("Out of memory for workers.\n");
+		exit(1);
+	}
+
+	if(uring_mode) {
+		Uring probe(1);
+		if(!probe.ok() || !probe.has_timeouts()) {
+			printf("io_uring is unavailable, using epoll.\n");
+			uring_mode = 0;
+		}
+	}
+
+	for(i = 0; i < count; i = i + 1) {
+		Worker *w = &workers[i];
+		w->id = i;
+		w->records = records;
+		w->timers = new TimerWheel(now_tick());
+		w->solver = new Solver();
+		w->ultimate_bot = new UltimateBot();
+		pthread_mutex_init(&w->lock, NULL);
+
+		if((w->epfd = epoll_create1(0)) == -1 || (w->wakefd = eventfd(0, EFD_NONBLOCK)) == -1) {
+			printf("Unable to create worker %d: %s\n", i, strerror(errno));
+			exit(1);
+		}
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL; //the wake-up eventfd is the only one without a Conn
+		epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wakefd, &ev);
+
+		if(uring_mode) {
+			w->ring = new Uring(URING_ENTRIES);
+			if(!w->ring->ok()) {
+				printf("Unable to create io_uring for worker %d.\n", i);
+				exit(1);
+			}
+		}
+
+		if(pthread_create(&w->thread, NULL, worker_loop, w) != 0) {
+			printf("Unable to start worker %d.\n", i);
+			exit(1);
+		}
+
+		CPU_ZERO(&cpus);
+		CPU_SET(i % ncpu, &cpus);
+		pthread_setaffinity_np(w->thread, sizeof(cpus), &cpus);
+	}
+
+	num_workers = count;
+	dprintf("Started %d workers.\n", count);
+}
+
+/*
+*	Hands a pair of clients to the worker with the fewest matches. If that
+*	worker still had hand-offs queued it is busy, so its neighbour is woken
+*	too and may steal the new one.
+*/
+void dispatch_match(int client1_sock, int client2_sock, int player1_index, int player2_index) {
+	int best = least_loaded_worker();
+	uint64_t one = 1;
+	if(push_handoff(&workers[best], client1_sock, client2_sock, player1_index, player2_index) > 1 &&
+	   num_workers > 1) {
+		write(workers[(best + 1) % num_workers].wakefd, &one, sizeof(one));
+	}
+	write(workers[best].wakefd, &one, sizeof(one));
+}
+
+void dispatch_login(int sock) {
+	dispatch_match(sock, -1, -1, -1);
+}
+
+int least_loaded_worker() {
+	int best = 0;
+	int best_load = -1;
+	int load, i;
+
+	for(i = 0; i < num_workers; i = i + 1) {
+		load = __atomic_load_n(&workers[i].live_matches, __ATOMIC_RELAXED) +
+		       __atomic_load_n(&workers[i].queued, __ATOMIC_RELAXED);
+		if(best_load == -1 || load < best_load) {
+			best = i;
+			best_load = load;
+		}
+	}
+	return best;
+}
+
+/*
+*	Queues a pair on a worker and returns how many pairs it now has queued
+*/
+int push_handoff(Worker *w, int client1_sock, int client2_sock, int player1_index, int player2_index) {
+	Handoff *h = (Handoff *)malloc(sizeof(Handoff));
+	int queued;
+
+	if(h == NULL) {
+		printf("Out of memory for a hand-off.\n");
+		exit(1);
+	}
+	h->sock[0] = client1_sock;
+	h->sock[1] = client2_sock;
+	h->player_index[0] = player1_index;
+	h->player_index[1] = player2_index;
+	h->next = NULL;
+
+	pthread_mutex_lock(&w->lock);
+	if(w->tail == NULL) {
+		w->head = h;
+	} else {
+		w->tail->next = h;
+	}
+	w->tail = h;
+	queued = __atomic_add_fetch(&w->queued, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&w->lock);
+
+	return queued;
+}
+
+Handoff *pop_handoff(Worker *w) {
+	Handoff *h;
+
+	pthread_mutex_lock(&w->lock);
+	h = w->head;
+	if(h != NULL) {
+		w->head = h->next;
+		if(w->head == NULL) {
+			w->tail = NULL;
+		}
+		__atomic_sub_fetch(&w->queued, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return h;
+}
+
+/*
+*	Starts every match or login queued on this worker. Once its own queue is empty it
+*	steals from neighbours that have a backlog.
+*/
+void take_handoffs(Worker *w) {
+	Handoff *h;
+	Match *m;
+	int i, victim, bot;
+
+	for(i = 0; i < num_workers; i = i + 1) {
+		victim = (w->id + i) % num_workers;
+
+		//only steal from a neighbour that has more than one queued
+		if(victim != w->id && __atomic_load_n(&workers[victim].queued, __ATOMIC_RELAXED) < 2) {
+			continue;
+		}
+
+		while((h = pop_handoff(&workers[victim])) != NULL) {
+			if(victim != w->id) {
+				dprintf("Worker %d stole a match from worker %d.\n", w->id, victim);
+			}
+
+			bot = h->sock[1] == BOT_SEAT;
+			if(bot && (h->sock[1] = eventfd(0, EFD_CLOEXEC)) == -1) {
+				//the seat needs a descriptor of its own for send_msg() to find it by
+				printf("Unable to seat the bot: %s\n", strerror(errno));
+				lobby_join(h->sock[0], h->player_index[0]);
+				free(h);
+				continue;
+			}
+
+			m = match_create(w, h->sock[0], h->sock[1]);
+			m->player_index[0] = h->player_index[0];
+			m->player_index[1] = h->player_index[1];
+			free(h);
+
+			worker_watch(w, &m->conn[0]);
+			if(bot) {
+				m->conn[1].bot = 1;
+				fd_conns[m->conn[1].sock] = &m->conn[1];
+			} else if(m->conn[1].sock != -1) {
+				worker_watch(w, &m->conn[1]);
+			}
+
+			match_start(m, w->records);
+
+			if(victim != w->id) {
+				break; //leave the rest to their owner
+			}
+		}
+	}
+}
+
+/*
+*	Starts receiving from a client on this worker
+*/
+void worker_watch(Worker *w, Conn *c) {
+	struct epoll_event ev;
+
+	fd_conns[c->sock] = c;
+	if(w->ring != NULL) {
+		c->io = new ConnIO();
+		conn_recv(w, c);
+		return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = c;
+	epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->sock, &ev);
+}
+
+void *worker_loop(void *arg) {
+	Worker *w = (Worker *)arg;
+	struct epoll_event events[MAX_EVENTS];
+	struct iovec iov[2];
+	int n, i;
+	int read_count;
+	uint64_t wakeups;
+	Conn *c;
+	Match *m;
+
+	if(w->ring != NULL) {
+		worker_loop_uring(w);
+		return NULL;
+	}
+
+	while(1) {
+		n = epoll_wait(w->epfd, events, MAX_EVENTS, timer_wait_ms(w->timers));
+		if(n == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			printf("epoll_wait: %s\n", strerror(errno));
+			exit(1);
+		}
+
+		for(i = 0; i < n; i = i + 1) {
+			c = (Conn *)events[i].data.ptr;
+
+			if(c == NULL) {
+				read(w->wakefd, &wakeups, sizeof(wakeups));
+				take_handoffs(w);
+				take_thoughts(w);
+				continue;
+			}
+
+			m = c->match;
+			if(m->closed) {
+				continue; //closed earlier in this batch
+			}
+
+			read_count = readv(c->sock, iov, c->in.space(iov));
+			if(read_count <= 0) {
+				dprintf("Client left the game.\n");
+				match_close(m);
+				continue;
+			}
+
+			if(conn_received(c, read_count)) {
+				match_close(m);
+			}
+		}
+
+		w->timers->advance(now_tick());
+		conn_flush(w);
+
+		//nothing in this batch can refer to a closed match any more
+		sweep_dead_matches(w);
+	}
+
+	return NULL;
+}
+
+/*
+*	The worker loop for the io_uring backend. Every client always has one
+*	receive in flight; receives, sends and hand-off wake-ups queued while
+*	handling a batch of completions go to the kernel in one system call.
+*/
+void worker_loop_uring(Worker *w) {
+	struct io_uring_cqe *cqe;
+	Conn *c;
+	Match *m;
+	int op, res;
+
+	w->ring->prep_read(w->wakefd, &w->wakeups, sizeof(w->wakeups), OP_WAKE);
+
+	while(1) {
+		conn_flush(w);
+		w->ring->submit_and_wait(1, timer_wait_ms(w->timers));
+
+		while((cqe = w->ring->peek()) != NULL) {
+			op = cqe->user_data & OP_MASK;
+			c = (Conn *)(cqe->user_data & ~(uint64_t)OP_MASK);
+			res = cqe->res;
+			w->ring->seen();
+
+			if(op == OP_WAKE) {
+				take_handoffs(w);
+				take_thoughts(w);
+				w->ring->prep_read(w->wakefd, &w->wakeups, sizeof(w->wakeups), OP_WAKE);
+				continue;
+			}
+
+			c->io->in_flight = c->io->in_flight - 1;
+			if(op == OP_SEND) {
+				conn_sent(w, c, res);
+				continue;
+			}
+
+			m = c->match;
+			if(m->closed) {
+				continue; //closed while the receive was in flight
+			}
+
+			if(res <= 0) {
+				dprintf("Client left the game.\n");
+				match_close(m);
+				continue;
+			}
+			if(conn_received(c, res)) {
+				match_close(m);
+				continue;
+			}
+
+			conn_recv(w, c);
+		}
+
+		w->timers->advance(now_tick());
+
+		sweep_dead_matches(w);
+	}
+}
+
+/*
+*	Queues a message for a client. It goes out with everything else queued
+*	for that client in one send at the end of the batch, or when a subserver
+*	next waits for input.
+*/
+int conn_queue(Conn *c, const void *msg, int len, const char *what) {
+	Worker *w = c->match->worker;
+
+	if(c->out_failed) {
+		return -1;
+	}
+	if(c->out_len + len > OUT_BUFFER) {
+		printf("Error sending %s message to client: output queue is full\n", what);
+		return -1;
+	}
+	memcpy(&c->out[c->out_len], msg, len);
+	c->out_len = c->out_len + len;
+	c->out_count = c->out_count + 1;
+
+	if(!c->dirty && w != NULL) {
+		c->dirty = 1;
+		c->next_dirty = w->dirty;
+		w->dirty = c;
+	}
+	return 0;
+}
+
+/*
+*	Sends everything queued for a client with one system call, or a few if
+*	the socket takes it in pieces. On failure the client's output is dropped
+*	from then on and -1 is returned; the caller ends the match.
+*/
+int conn_write(Conn *c) {
+	int sent = 0;
+	int n;
+
+	if(c->out_len == 0 || c->out_failed) {
+		c->out_len = 0;
+		c->out_count = 0;
+		return c->out_failed ? -1 : 0;
+	}
+
+	__atomic_add_fetch(&send_stats.messages, c->out_count, __ATOMIC_RELAXED);
+	while(sent < c->out_len) {
+		n = send(c->sock, &c->out[sent], c->out_len - sent, MSG_NOSIGNAL);
+		__atomic_add_fetch(&send_stats.sends, 1, __ATOMIC_RELAXED);
+		if(n == -1 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			printf("Error sending to client: %s\n", strerror(errno));
+			__atomic_add_fetch(&send_stats.failed, 1, __ATOMIC_RELAXED);
+			c->out_failed = 1;
+			break;
+		}
+		sent = sent + n;
+	}
+	__atomic_add_fetch(&send_stats.bytes, sent, __ATOMIC_RELAXED);
+
+	c->out_len = 0;
+	c->out_count = 0;
+	return c->out_failed ? -1 : 0;
+}
+
+/*
+*	Sends the output of every client that queued some during this batch.
+*	With io_uring that is a send for each client with none in flight, all
+*	handed to the kernel by the next submit.
+*/
+void conn_flush(Worker *w) {
+	Conn *c;
+
+	while(w->dirty != NULL) {
+		c = w->dirty;
+		w->dirty = c->next_dirty;
+		c->dirty = 0;
+
+		if(c->bot) {
+			bot_answer(w, c);
+			continue;
+		}
+
+		if(w->ring == NULL) {
+			if(conn_write(c) == -1 && !c->match->closed) {
+				match_close(c->match);
+			}
+			continue;
+		}
+
+		if(c->io->send_len > 0 || c->out_len == 0) {
+			continue; //conn_sent() picks the rest up
+		}
+
+		memcpy(c->io->sending, c->out, c->out_len);
+		c->io->send_len = c->out_len;
+		c->io->send_off = 0;
+		__atomic_add_fetch(&send_stats.messages, c->out_count, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&send_stats.sends, 1, __ATOMIC_RELAXED);
+		c->out_len = 0;
+		c->out_count = 0;
 
-void send_record_msg(int socket, Player *record);
+		c->io->in_flight = c->io->in_flight + 1;
+		w->ring->prep_send(c->sock, c->io->sending, c->io->send_len, (uint64_t)c | OP_SEND);
+	}
+}
 
-void print_records(Player *records);
-void print_board(char board[][3]);
-char checkWinner(char board[][3]);
-char get_player_symbol(char player);
-int get_player_index(int id, Player *records);
-void send_game_over(int socket, char flag, char board[][3]);
-void send_id_msg(int socket);
-void send_record_msg(int socket, Player *record);
-void send_inv_msg(int socket, char flag);
-void send_turn_msg(int socket, char board[][3]);
-void send_wait_msg(int socket);
-void append_board(char msg[], char start_index, char board[][3]);
+/*
+*	Handles a finished send: finishes a short one, then sends what queued up.
+*	A failed one drops the client's output and ends its match.
+*/
+void conn_sent(Worker *w, Conn *c, int res) {
+	if(res < 0) {
+		printf("Error sending to client: %s\n", strerror(-res));
+		__atomic_add_fetch(&send_stats.failed, 1, __ATOMIC_RELAXED);
+		c->out_failed = 1;
+		c->io->send_len = 0;
+		c->out_len = 0;
+		c->out_count = 0;
+		if(!c->match->closed) {
+			match_close(c->match);
+		}
+		return;
+	}
+	__atomic_add_fetch(&send_stats.bytes, res, __ATOMIC_RELAXED);
+
+	c->io->send_off = c->io->send_off + res;
+	if(c->io->send_off < c->io->send_len) {
+		__atomic_add_fetch(&send_stats.sends, 1, __ATOMIC_RELAXED);
+		c->io->in_flight = c->io->in_flight + 1;
+		w->ring->prep_send(c->sock, &c->io->sending[c->io->send_off], c->io->send_len - c->io->send_off,
+		                   (uint64_t)c | OP_SEND);
+		return;
+	}
 
-void reap_terminated_child(int status);              // reap subservers
-void *get_in_addr(struct sockaddr * sa);             // get internet address
-int get_server_socket(char *hostname, char *port);   // get a server socket
-int start_server(int serv_socket, int backlog);      // start server's listening
-int accept_client(int serv_sock);                    // accept a connection from client
-void subserver(int client1_sock, int client2_sock, Player *records); // subserver - subserver
-void print_ip( struct addrinfo *ai);                 // print IP info from getaddrinfo()
+	c->io->send_len = 0;
+	if(c->out_len > 0 && !c->dirty) {
+		c->dirty = 1;
+		c->next_dirty = w->dirty;
+		w->dirty = c;
+	}
+}
 
-Semaphore mutex(1, MEMORY_KEY);
+/*
+*	Arms a receive into the free part of a client's buffer
+*/
+void conn_recv(Worker *w, Conn *c) {
+	int room;
+	char *at = c->in.write_ptr(&room);
 
-int debug = 0; //global variable to determine whether or not server is being run in "debug mode"
+	c->io->in_flight = c->io->in_flight + 1;
+	w->ring->prep_recv(c->sock, at, room, (uint64_t)c | OP_RECV);
+}
 
-int main(int argc, char *argv[]) {
-	int server_sock = 0;
-	
-	int client1_sock = 0;
-	int client2_sock = 0;
+/*
+*	Plays the bot seat. The game talks to it like any client, so what it
+*	queued is read back here instead of sent: each P_YOUR_TURN is answered
+*	with a P_MOVE from the tablebase or the worker's solver, or from the
+*	planners with -M, each P_ULTIMATE_TURN with one from the worker's
+*	ultimate bot, and everything else is ignored.
+*/
+void bot_answer(Worker *w, Conn *c) {
+	char out[OUT_BUFFER];
+	char move[P_MOVE_LEN];
+	Board board;
+	UltimateBoard grid;
+	Match *m = c->match;
+	int len = c->out_len;
+	int at = 0;
+	int n, i, sq;
+
+	//taking the move queues more for the bot, so work from a copy
+	memcpy(out, c->out, len);
+	c->out_len = 0;
+	c->out_count = 0;
+
+	while(at < len && !m->closed) {
+		n = server_msg_len(out[at]);
+		if(n <= 0 || at + n > len) {
+			break;
+		}
 
-	Shared<Player> records(MAX_RECORDS, MEMORY_KEY);
+		if(out[at] == P_ULTIMATE_TURN) {
+			grid.load(&out[at + 1], out[at + 82]);
+			sq = w->ultimate_bot->best_move(grid);
 
-	if(argc == 3 && strcmp("-d", argv[2]) == 0) {
-		printf("Running in debug mode.\n");
-		debug = 1;
-	}
-	
-	load_records(argv[1], records);
+			move[0] = P_MOVE;
+			move[1] = UltimateBoard::row_of(sq / 9, sq % 9);
+			move[2] = UltimateBoard::col_of(sq / 9, sq % 9);
+			if(match_on_input(m, c->seat, move, P_MOVE_LEN)) {
+				match_close(m);
+			}
+		} else if(out[at] == P_YOUR_TURN) {
+			board.clear();
+			for(i = 0; i < 9; i = i + 1) {
+				if(out[at + 1 + i] != 0) {
+					board.play(i, out[at + 1 + i]);
+				}
+			}
+			if(planners != NULL && bot_think(m, c->seat, &board) == 0) {
+				at = at + n;
+				continue;
+			}
+			if(tablebase.loaded()) {
+				sq = tablebase.best_move(board);
+			} else {
+				sq = w->solver->best_move(board);
+			}
 
-	print_records(records);
+			move[0] = P_MOVE;
+			move[1] = sq / 3;
+			move[2] = sq % 3;
+			if(match_on_input(m, c->seat, move, P_MOVE_LEN)) {
+				match_close(m);
+			}
+		}
+		at = at + n;
+	}
+}
 
-	signal(SIGCHLD, reap_terminated_child);
+/*
+*	Queues a bot move for the planners. The match waits for it like any other
+*	move; the worker plays it when a planner hands it back. Returns 0, or -1
+*	if the queue is full and the caller should pick the move itself.
+*/
+int bot_think(Match *m, int seat, Board *board) {
+	Think *t;
+	int sq;
+
+	pthread_mutex_lock(&planner_lock);
+	if(planner_queued >= PLANNER_QUEUE) {
+		pthread_mutex_unlock(&planner_lock);
+		__atomic_add_fetch(&planner_stats.full, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+	planner_queued = planner_queued + 1;
+	pthread_mutex_unlock(&planner_lock);
 
-	//set up the server
-	dprintf("Initializing server.\n");
-	server_sock = get_server_socket(HOST, HTTPPORT);
-	
-	if(start_server(server_sock, BACKLOG) == -1) {
-		printf("Error starting server: %s.\n", strerror(errno));
-		exit(1);
+	t = new Think();
+	for(sq = 0; sq < 9; sq = sq + 1) {
+		if(board->at(sq) != 0) {
+			t->board.play(sq / 3, sq % 3, board->at(sq));
+		}
+	}
+	t->match = m;
+	t->seat = seat;
+	t->symbol = board->moves() % 2 == 0 ? 'X' : 'O';
+	t->queued = now_ns();
+	m->conn[seat].thinking = 1;
+
+	pthread_mutex_lock(&planner_lock);
+	if(planner_tail == NULL) {
+		planner_head = t;
+	} else {
+		planner_tail->next = t;
 	}
+	planner_tail = t;
+	pthread_cond_signal(&planner_ready);
+	pthread_mutex_unlock(&planner_lock);
+	return 0;
+}
 
-	while(1) {
-		//client 1 has already connected to the server
-		if(client1_sock != 0) {
-			client2_sock = accept_client(server_sock);
-			dprintf("Received connection from second client.\n");
-			
-			//fork for subserver
-			if (!fork()) { // child process, so start the subserver
-			
-			   close(server_sock); //no longer needed in child process
-			   dprintf("Preparing to play.\n");
-			   subserver(client1_sock, client2_sock, records);
-			   
-			} else { //parent process
-			
-				//reset client sockets for more connections
-			   close(client1_sock);
-			   close(client2_sock);
-			   client1_sock = 0;
-			   client2_sock = 0;
-			}
-			
-		} else { //client 1 has not connected yet
-			client1_sock = accept_client(server_sock);
-			dprintf("Received connection from first client.\n");
-
-			char msg = P_WAIT; //tell the client just to wait
-			if(send(client1_sock, &msg, sizeof(msg), 0) < 0) {
-				printf("Unable to send: %s\n", strerror(errno));
-				exit(1);
+/*
+*	Plays the bot moves the planners have finished for this worker's matches.
+*	A match that ended while its move was searched for just lets go of it.
+*/
+void take_thoughts(Worker *w) {
+	Think *t, *next;
+	Match *m;
+	char move[P_MOVE_LEN];
+
+	pthread_mutex_lock(&w->lock);
+	t = w->thoughts;
+	w->thoughts = NULL;
+	pthread_mutex_unlock(&w->lock);
+
+	for(; t != NULL; t = next) {
+		next = t->next;
+		m = t->match;
+		m->conn[t->seat].thinking = 0;
+		if(!m->closed) {
+			move[0] = P_MOVE;
+			move[1] = t->square / TicTacToe::COLS;
+			move[2] = t->square % TicTacToe::COLS;
+			if(match_on_input(m, t->seat, move, P_MOVE_LEN)) {
+				match_close(m);
 			}
 		}
+		delete t;
 	}
+}
 
-	save_records(argv[1], records);
-
-	mutex.remove();
-	records.remove();
+/*
+*	Starts the planners: one search per threads cores, so that many bot
+*	moves are searched for at once and the cores are all in use, and a
+*	move only waits for a planner when every one of them is busy
+*/
+void start_planner(int threads) {
+	int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int i;
 
-	exit(0);
+	if(threads <= 0) {
+		threads = 1;
+	}
+	num_planners = ncpu / threads > 1 ? ncpu / threads : 1;
+	planners = (Planner *)calloc(num_planners, sizeof(Planner));
+	if(planners == NULL) {
+		printf("Out of memory for planners.\n");
+		exit(1);
+	}
+	for(i = 0; i < num_planners; i = i + 1) {
+		planners[i].id = i;
+		planners[i].mcts = new Mcts<TicTacToe>(threads, PLANNER_NODES);
+		if(pthread_create(&planners[i].thread, NULL, planner_loop, &planners[i]) != 0) {
+			printf("Unable to start planner %d.\n", i);
+			exit(1);
+		}
+	}
+	dprintf("Bot moves get %d ms of Monte Carlo search on %d threads, %d at once.\n", bot_think_ms, threads,
+	        num_planners);
 }
 
 /*
-*	Load player records from the specified file
+*	Searches for queued bot moves one after another, bot_think_ms on every
+*	thread of the planner's own search, and hands each back to the worker
+*	that owns its match. Every planner runs this on the one queue.
 */
+void *planner_loop(void *arg) {
+	Planner *p = (Planner *)arg;
+	Think *t;
+	Worker *w;
+	uint64_t one = 1;
+	long wait, max;
 
-void load_records(char *filename, Player *records) {
-	int fd = open(filename, O_RDWR, S_IRWXU | S_IRWXO);
-	int num = 0;
-	int i = 0;
-	
-	num = read(fd, &records[i], sizeof(Player));
-	while(num > 0) {
-		i = i + 1;
-		
-		if(i == MAX_RECORDS) {
-			printf("Max number of users reached: %d.\n", MAX_RECORDS);
+	while(1) {
+		pthread_mutex_lock(&planner_lock);
+		while(planner_head == NULL) {
+			pthread_cond_wait(&planner_ready, &planner_lock);
 		}
-		
-		num = read(fd, &records[i], sizeof(Player));
+		t = planner_head;
+		planner_head = t->next;
+		if(planner_head == NULL) {
+			planner_tail = NULL;
+		}
+		planner_queued = planner_queued - 1;
+		pthread_mutex_unlock(&planner_lock);
+
+		wait = now_ns() - t->queued;
+		max = __atomic_load_n(&planner_stats.wait_max, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&planner_stats.moves, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&planner_stats.wait_total, wait, __ATOMIC_RELAXED);
+		while(wait > max && !__atomic_compare_exchange_n(&planner_stats.wait_max, &max, wait, 1,
+		                                                 __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+		t->square = p->mcts->search(t->board, t->symbol, bot_think_ms * 1000L);
+		dprintf("Planner %d: %ld playouts for square %d.\n", p->id, p->mcts->playouts(), t->square);
+
+		w = t->match->worker;
+		pthread_mutex_lock(&w->lock);
+		t->next = w->thoughts;
+		w->thoughts = t;
+		pthread_mutex_unlock(&w->lock);
+		write(w->wakefd, &one, sizeof(one));
 	}
-	
-	close(fd);
+
+	return NULL;
 }
 
-void save_records(char *filename, Player *records) {
-	int fd = open(filename, O_WRONLY | O_CREAT, S_IRWXU | S_IRWXO);
-	int num = 0;
-	int i = 0;
-	
-	for(i = 0; i < MAX_RECORDS; i = i + 1) {
-		num = write(fd, &records[i], sizeof(Player));
-	}
-		
-	close(fd);
+/*
+*	Prints how many bot moves the planners searched for and how long they
+*	waited in the queue for a planner first
+*/
+void print_planner_stats() {
+	long moves = __atomic_load_n(&planner_stats.moves, __ATOMIC_RELAXED);
+
+	printf("planners: %d, %ld moves, wait avg %ld us, max %ld us, %ld left to the solver by a full queue\n",
+	       num_planners, moves,
+	       moves > 0 ? __atomic_load_n(&planner_stats.wait_total, __ATOMIC_RELAXED) / moves / 1000 : 0,
+	       __atomic_load_n(&planner_stats.wait_max, __ATOMIC_RELAXED) / 1000,
+	       __atomic_load_n(&planner_stats.full, __ATOMIC_RELAXED));
+	fflush(stdout);
 }
 
+/*
+*	Frees closed matches and closes their sockets, once their last messages
+*	are sent and, with io_uring, the kernel is done with their buffers.
+*/
+void sweep_dead_matches(Worker *w) {
+	Match **prev = &w->dead_matches;
+	Match *m;
+	Conn *c;
+	int i, busy;
+
+	while(*prev != NULL) {
+		m = *prev;
+
+		busy = 0;
+		for(i = 0; i < 2; i = i + 1) {
+			c = &m->conn[i];
+			if(c->dirty || (c->out_len > 0 && !c->out_failed) || c->thinking) {
+				busy = 1;
+			}
+			if(c->io != NULL && (c->io->in_flight > 0 || c->io->send_len > 0)) {
+				busy = 1;
+			}
+		}
+		if(busy) {
+			prev = &m->next_dead;
+			continue;
+		}
 
-void print_records(Player *records) {
-	int i;
-	for(i = 0; i < MAX_RECORDS; i = i + 1) {
-		printf("Player: id = %d, first name = %s, last name = %s\n", records[i].playerID, records[i].firstName, records[i].lastName);
+		*prev = m->next_dead;
+		if(m->handed_off) {
+			fd_conns[m->conn[0].sock] = NULL;
+			lobby_join(m->conn[0].sock, m->player_index[0]);
+		} else {
+			for(i = 0; i < 2; i = i + 1) {
+				if(m->conn[i].sock != -1) {
+					fd_conns[m->conn[i].sock] = NULL;
+					close(m->conn[i].sock);
+				}
+			}
+		}
+		match_free(m);
 	}
 }
 
 /*
-*	Where child processes will communicate with clients and run the game.
+*	Takes the next client from a batch of io_uring accepts, refilling the
+*	batch with a single system call once every accepted client is handed out
 */
-void subserver(int client1_sock, int client2_sock, Player *records) {
+int accept_client_uring(AcceptBatch *ab, int serv_sock) {
+	struct io_uring_cqe *cqe;
+	int slot, sock;
+
+	if(!ab->armed) {
+		//keep ACCEPT_DEPTH accepts in flight from now on
+		for(slot = 0; slot < ACCEPT_DEPTH; slot = slot + 1) {
+			ab->addr_len[slot] = sizeof(struct sockaddr_storage);
+			ab->ring->prep_accept(serv_sock, (struct sockaddr *)&ab->addr[slot],
+			                      &ab->addr_len[slot], slot);
+		}
+		ab->armed = 1;
+	}
 
-	//these will be used to control whose turn it is
-	int current_sock;
-	int waiting_sock;
+	while(ab->ready_count == 0) {
+		ab->ring->submit_and_wait(1);
 
-	//player data
-	int player1_index = -1;
-	int player2_index = -1;
+		while((cqe = ab->ring->peek()) != NULL) {
+			slot = cqe->user_data;
+			sock = cqe->res;
+			ab->ring->seen();
 
-	//game data
-	char board[3][3];
-	char turn = 1; //tracks whose turn it is
-	char turn_count = 0;
-	char winner = 0;
-	
-	//networking data
-	int read_count = -1;
-	int BUFFERSIZE = 256;
-	char buffer[BUFFERSIZE+1];
+			if(sock < 0) {
+				printf("socket accept error\n");
+			} else {
+				print_client(&ab->addr[slot]);
+				ab->ready[(ab->ready_head + ab->ready_count) % ACCEPT_DEPTH] = sock;
+				ab->ready_count = ab->ready_count + 1;
+			}
 
-	char x, y;
-	
+			ab->addr_len[slot] = sizeof(struct sockaddr_storage);
+			ab->ring->prep_accept(serv_sock, (struct sockaddr *)&ab->addr[slot],
+			                      &ab->addr_len[slot], slot);
+		}
+	}
 
-	//get players to "login"
-	int t_id = 0;
-	dprintf("Getting player 1 user id...\n");
-	while(player1_index == -1) {
-		send_id_msg(client1_sock);
+	sock = ab->ready[ab->ready_head];
+	ab->ready_head = (ab->ready_head + 1) % ACCEPT_DEPTH;
+	ab->ready_count = ab->ready_count - 1;
+	return sock;
+}
 
-		//get user input from client
-		read_count = recv(client1_sock, buffer, BUFFERSIZE, 0);
-		buffer[read_count] = '\0';
+Match *match_create(Worker *w, int client1_sock, int client2_sock) {
+	Match *m = new Match();
+	int i;
 
-		t_id = buffer[1];
-		player1_index = get_player_index(t_id, records);
+	m->conn[0].sock = client1_sock;
+	m->conn[1].sock = client2_sock;
+	for(i = 0; i < 2; i = i + 1) {
+		m->conn[i].seat = i;
+		m->conn[i].match = m;
+		m->player_index[i] = -1;
+	}
+	m->turn = 1;
+	m->worker = w;
+	m->turn_timer.fire = match_timed_out;
+	m->turn_timer.data = m;
+	m->match_timer.fire = match_timed_out;
+	m->match_timer.data = m;
+	if(w != NULL) {
+		m->timers = w->timers;
+		__atomic_add_fetch(&w->live_matches, 1, __ATOMIC_RELAXED);
 	}
-	send_record_msg(client1_sock, &records[player1_index]);
-	
-	t_id = 0;
-	dprintf("Getting player 2 user id...\n");
-	while(player2_index == -1) {
-		send_id_msg(client2_sock);
 
-		//get user input from client
-		read_count = recv(client2_sock, buffer, BUFFERSIZE, 0);
-		buffer[read_count] = '\0';
+	return m;
+}
 
-		t_id = buffer[1];
-		player2_index = get_player_index(t_id, records);
-	}
-	send_record_msg(client2_sock, &records[player2_index]);
-	//both players are now logged in
-	
-	//initialize the board array to all 0's
-	dprintf("Preparing game board...\n");
-	for (x = 0; x < 3; x = x + 1) {
-		for(y = 0; y < 3; y = y + 1) {
-			board[x][y] = 0;
+/*
+*	Starts the game, or just the login of a lone client, which runs until it
+*	first waits for a client
+*/
+void match_start(Match *m, Player *records) {
+	if(m->conn[1].sock == -1) {
+		m->task = login_client(m, records);
+	} else {
+		if(m->timers != NULL && match_timeout > 0) {
+			m->timers->add(&m->match_timer, now_tick() + match_timeout * 1000L / TIMER_TICK_MS);
 		}
+		m->task = play_match(m, records);
 	}
+	match_arm_turn(m);
+}
 
-	//let the game begin!
-	while(turn_count < 9) {
-		
-		//set up "reply" sockets based on whose turn it is
-		if(turn == 1) {
-			current_sock = client1_sock;
-			waiting_sock = client2_sock;
-		} else {
-			current_sock = client2_sock;
-			waiting_sock = client1_sock;
+/*
+*	Takes count more bytes read into a client's buffer and hands the game
+*	every whole message there is. Returns 1 once the game is over.
+*/
+int conn_received(Conn *c, int count) {
+	char *msg;
+	int len;
+
+	c->in.wrote(count);
+	while((len = c->in.next(&msg)) > 0) {
+		if(match_on_input(c->match, c->seat, msg, len)) {
+			return 1;
 		}
+		c->in.consume(len);
+	}
+	return 0;
+}
 
-		//tell idle player to wait
-		send_wait_msg(waiting_sock);
-		//alert current player it's her turn
-		send_turn_msg(current_sock, board);
+/*
+*	Hands one message from the client in seat to the game. Messages from a
+*	client the game is not waiting for are dropped. Returns 1 once the game
+*	is over.
+*/
+int match_on_input(Match *m, int seat, char *buffer, int len) {
+	if(m->inbox.deliver(seat, buffer, len)) {
+		match_arm_turn(m);
+	}
+	return m->task.done();
+}
 
-		//get user input from client
-		read_count = recv(current_sock, buffer, BUFFERSIZE, 0);
-		buffer[read_count] = '\0';
-
-		if(buffer[0] == P_MOVE) {
-			x = buffer[1];
-			y = buffer[2];
-			
-			dprintf("Player input: %d %d\n", x, y);
-			
-			//first, make sure the input is valid
-			if(x < 0 || x > 2 || y < 0 || y > 2) {
-				dprintf("Input error: out of range\n");
-				send_inv_msg(current_sock, Q_OUT_OF_RANGE);
-				continue;
-			} else if(board[x][y] > 0) {
-				dprintf("Input error: location taken\n");
-				send_inv_msg(current_sock, Q_LOC_TAKEN);
-				continue;
-			}
-			
-			//update the board
-			board[x][y] = get_player_symbol(turn);
-			
-			if(debug > 0) {
-				print_board(board);
-			}
-			
-			turn_count = turn_count + 1;
-			
-			winner = checkWinner(board);
-			if(winner != 0) {
-				if(winner == 'X') {
-					dprintf("Game over. Player 1 wins!");
-
-					mutex.wait();
-					//CRITICAL SECTION!!!!!!
-					records[player1_index].wins++;
-					records[player2_index].losses++;
-					mutex.signal();
-
-					send_game_over(client1_sock, Q_YOU_WON, board);
-					send_game_over(client2_sock, Q_YOU_LOST, board);
-					close(client1_sock);
-					close(client2_sock);
-					exit(0); 
-				} else {
-					dprintf("Game over. Player 2 wins!");
-
-					mutex.wait();
-					//CRITICAL SECTION!!!!!!
-					records[player2_index].wins++;
-					records[player1_index].losses++;
-					mutex.signal();
-
-					send_game_over(client2_sock, Q_YOU_WON, board);
-					send_game_over(client1_sock, Q_YOU_LOST, board);
-					close(client1_sock);
-					close(client2_sock);
-					exit(0);
-				}
-			}
-		}
+/*
+*	Gives the client the game is now waiting for the full time to log in
+*	or move, and drops the deadlines of a finished game
+*/
+void match_arm_turn(Match *m) {
+	if(m->timers == NULL) {
+		return;
+	}
+	if(m->task.done()) {
+		m->timers->cancel(&m->turn_timer);
+		m->timers->cancel(&m->match_timer);
+		return;
+	}
+	if(turn_timeout > 0) {
+		m->timers->add(&m->turn_timer, now_tick() + turn_timeout * 1000L / TIMER_TICK_MS);
+	}
+}
 
-		//prepare for next turn
-		if(turn == 1) {
-			turn = 2;
-		} else {
-			turn = 1;
-		}
+/*
+*	A client ran out of time, or the game did. The game is told with an
+*	empty message from whoever it was waiting for, which forfeits for them.
+*/
+void match_timed_out(Timer *t) {
+	Match *m = (Match *)t->data;
+	int seat = m->inbox.waiting_for();
+
+	if(m->closed || seat == -1) {
+		return;
 	}
-	
-	//if we make it this far, the game was a draw
-	send_game_over(client1_sock, Q_GAME_DRAW, board);
-	send_game_over(client2_sock, Q_GAME_DRAW, board);
+	dprintf("Player %d ran out of time.\n", seat + 1);
 
-	records[player1_index].ties++;
-	records[player2_index].ties++;
+	if(match_on_input(m, seat, NULL, 0) && m->worker != NULL) {
+		match_close(m);
+	}
+}
 
-	//goodbye
-	close(client1_sock);
-	close(client2_sock);
+/*
+*	Frees a match along with its game and any io_uring buffers
+*/
+void match_free(Match *m) {
+	delete m->conn[0].io;
+	delete m->conn[1].io;
+	delete m;
+}
 
-	exit(0);
+/*
+*	Stops reading from both clients and queues the match to be freed once
+*	its last messages are sent, when its sockets are closed. A client that
+*	just logged in is passed on to the lobby at that point instead.
+*/
+void match_close(Match *m) {
+	int i;
+
+	m->timers->cancel(&m->turn_timer);
+	m->timers->cancel(&m->match_timer);
+
+	for(i = 0; i < 2; i = i + 1) {
+		if(m->conn[i].sock == -1 || m->conn[i].bot) {
+			continue;
+		}
+		if(m->worker->ring == NULL) {
+			epoll_ctl(m->worker->epfd, EPOLL_CTL_DEL, m->conn[i].sock, NULL);
+		} else if(!m->handed_off) {
+			//wake the receive in flight; a logged in client has none
+			shutdown(m->conn[i].sock, SHUT_RD);
+		}
+	}
+	m->closed = 1;
+	m->next_dead = m->worker->dead_matches;
+	m->worker->dead_matches = m;
+	__atomic_sub_fetch(&m->worker->live_matches, 1, __ATOMIC_RELAXED);
 }
 
 /*
 *	Appends msg with a listing of the board to send to the client
 */
-void append_board(char msg[], char start_index, char board[][3]) {
-	char x, y, c;
+void append_board(char msg[], char start_index, Board *board) {
+	char i;
 	
-	c = start_index;
-	for (x = 0; x < 3; x = x + 1) {
-		for (y = 0; y < 3; y = y + 1) {
-			msg[c] = board[x][y];
-			c = c + 1;
-		}
+	for (i = 0; i < 9; i = i + 1) {
+		msg[start_index + i] = board->at(i);
 	}
 
 }
 
+/*
+*	Appends msg with the 81 squares of an ultimate grid, row by row
+*/
+void append_grid(char msg[], int start_index, UltimateBoard *grid) {
+	int row, col;
+
+	for(row = 0; row < 9; row = row + 1) {
+		for(col = 0; col < 9; col = col + 1) {
+			msg[start_index + 9*row + col] = grid->at(UltimateBoard::sub_of(row, col),
+			                                          UltimateBoard::square_of(row, col));
+		}
+	}
+}
+
 /*
 *	Print the board for any users of the server
 */
-void print_board(char board[][3]) {
-	char x, y;
+void print_board(Board *board) {
+	char i;
 	
-	for (x = 0; x < 3; x = x + 1) {
-		for (y = 0; y < 3; y = y + 1) {
-			if(board[x][y] == 0) {
-				printf("_ ");
-			} else {
-				printf("%c ", board[x][y]);
-			}
+	for (i = 0; i < 9; i = i + 1) {
+		if(board->at(i) == 0) {
+			printf("_ ");
+		} else {
+			printf("%c ", board->at(i));
+		}
+		if((i + 1) % 3 == 0) {
+			printf("\n");
 		}
-		printf("\n");
 	}
 }
 
-int get_player_index(int id, Player *records) {
-	int i;
-	mutex.wait();
-	for(int i = 0; i < MAX_RECORDS; i++) {
-		if(records[i].playerID == id) return i;
-	}
-	mutex.signal();
-	return -1;
+int get_player_index(int id) {
+	return players.find(id);
 }
 
 /*
@@ -402,31 +2514,18 @@ char get_player_symbol(char player) {
 }
 
 /*
-*	Returns the winning symbol for board, or 0 is there is none
+*	Sends a protocol message. Messages to a client in a match are queued and
+*	sent together; a failed send ends that match rather than the server.
 */
-char checkWinner(char board[][3]) {
-	char i;
-	
-	//check horizontally
-	for(i = 0; i < 3; i=i+1) {
-		if(board[i][0] == board[i][1] && board[i][1] == board[i][2]) {
-			return board[i][0];
-		}
-	}
-	
-	//check vertically
-	for(i = 0; i < 3; i=i+1) {
-		if(board[0][i] == board[1][i] && board[1][i] == board[2][i]) {
-			return board[0][i];
-		}
+int send_msg(int socket, const void *msg, int len, const char *what) {
+	if(socket >= 0 && socket < max_fds && fd_conns[socket] != NULL) {
+		return conn_queue(fd_conns[socket], msg, len, what);
 	}
-	
-	//check diagonals
-	if((board[0][0] == board[1][1] && board[1][1] == board[2][2]) ||
-	   (board[0][2] == board[1][1] && board[1][1] == board[2][0])) {
-		return board[1][1];
+
+	if(send(socket, msg, len, MSG_NOSIGNAL) < 0) {
+		printf("Error sending %s message to client: %s\n", what, strerror(errno));
+		return -1;
 	}
-	
 	return 0;
 }
 
@@ -435,10 +2534,7 @@ char checkWinner(char board[][3]) {
 */
 void send_id_msg(int socket) {
 	char msg = P_UID;
-	if(send(socket, &msg, sizeof(msg), 0) < 0) {
-		perror("Error sending P_UID message to client.");
-		exit(1);
-	}
+	send_msg(socket, &msg, sizeof(msg), "P_UID");
 }
 
 /*
@@ -446,18 +2542,17 @@ void send_id_msg(int socket) {
 */
 void send_record_msg(int socket, Player *record) {
 	char msg[26];
+	Player r;
+	copy_record(record, &r);
 	msg[0] = P_RECORD;
-	msg[1] = record->playerID;
-	strcpy(&msg[2],record->firstName);
-	strcpy(&msg[12],record->lastName);
-	msg[23] = record->wins;
-	msg[24] = record->losses;
-	msg[25] = record->ties;
-
-	if(send(socket, &msg, sizeof(msg), 0) < 0) {
-		perror("Error sending P_RECORD message to client.");
-		exit(1);
-	}
+	msg[1] = r.playerID;
+	strcpy(&msg[2],r.firstName);
+	strcpy(&msg[12],r.lastName);
+	msg[23] = r.wins;
+	msg[24] = r.losses;
+	msg[25] = r.ties;
+
+	send_msg(socket, &msg, sizeof(msg), "P_RECORD");
 }
 
 
@@ -466,24 +2561,18 @@ void send_record_msg(int socket, Player *record) {
 */
 void send_wait_msg(int socket) {
 	char msg = P_WAIT;
-	if(send(socket, &msg, sizeof(msg), 0) < 0) {
-		perror("Error sending P_WAIT message to client.");
-		exit(1);
-	}
+	send_msg(socket, &msg, sizeof(msg), "P_WAIT");
 }
 
 /*
 *	Sends the "your turn" message to the client specified by socket
 */
-void send_turn_msg(int socket, char board[][3]) {
+void send_turn_msg(int socket, Board *board) {
 	char msg[10];
 	msg [0] = P_YOUR_TURN;
 	append_board(msg, 1, board);
 
-	if(send(socket, &msg, sizeof(msg), 0) < 0) {
-		perror("Error sending P_YOUR_TURN message to client.");
-		exit(1);
-	}
+	send_msg(socket, &msg, sizeof(msg), "P_YOUR_TURN");
 }
 
 /*
@@ -494,26 +2583,56 @@ void send_inv_msg(int socket, char flag) {
 	msg[0] = P_INVALID;
 	msg[1] = flag;
 
-	if(send(socket, &msg, sizeof(msg), 0) < 0) {
-		perror("Error sending P_INVALID message to client.");
-		exit(1);
-	}
+	send_msg(socket, &msg, sizeof(msg), "P_INVALID");
 }
 
 /*
 *	Sends the "game over" message to the client specified by socket.
 *	flag is the Q_ code corresponding to the game's result
 */
-void send_game_over(int socket, char flag, char board[][3]) {
+void send_game_over(int socket, char flag, Board *board) {
 	char msg[11];
 	msg[0] = P_GAMEOVER;
 	msg[1] = flag;
 	
 	append_board(msg, 2, board);
 
-	if(send(socket, &msg, sizeof(msg), 0) < 0) {
-		perror("Error sending P_GAME_OVER message to client.");
-		exit(1);
+	send_msg(socket, &msg, sizeof(msg), "P_GAME_OVER");
+}
+
+/*
+*	Sends the "your turn" message of an ultimate game: the grid and the
+*	board to move on
+*/
+void send_ultimate_turn_msg(int socket, UltimateBoard *grid) {
+	char msg[P_ULTIMATE_TURN_LEN];
+	msg[0] = P_ULTIMATE_TURN;
+	append_grid(msg, 1, grid);
+	msg[82] = grid->next;
+
+	send_msg(socket, &msg, sizeof(msg), "P_ULTIMATE_TURN");
+}
+
+/*
+*	Sends the "game over" message of an ultimate game
+*/
+void send_ultimate_over(int socket, char flag, UltimateBoard *grid) {
+	char msg[P_ULTIMATE_GAMEOVER_LEN];
+	msg[0] = P_ULTIMATE_GAMEOVER;
+	msg[1] = flag;
+	append_grid(msg, 2, grid);
+
+	send_msg(socket, &msg, sizeof(msg), "P_ULTIMATE_GAMEOVER");
+}
+
+/*
+*	Sends the "game over" message for whichever game the match is playing
+*/
+void send_match_over(Match *m, int socket, char flag) {
+	if(game_mode == GAME_ULTIMATE) {
+		send_ultimate_over(socket, flag, &m->ultimate);
+	} else {
+		send_game_over(socket, flag, &m->board);
 	}
 }
 
@@ -534,7 +2653,7 @@ void reap_terminated_child(int status) {
    while (waitpid(-1, NULL, WNOHANG) > 0);
 }
 
-int get_server_socket(char *hostname, char *port) {
+int get_server_socket(char *hostname, char *port, int reuseport) {
 	struct addrinfo hints, *servinfo, *p;
 	int status;
 	int server_socket;
@@ -562,6 +2681,11 @@ int get_server_socket(char *hostname, char *port) {
 		 printf("socket option\n");
 		 continue;
 	   }
+	   // let several listening sockets share the port
+	   if (reuseport && setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1) {
+		 printf("socket option\n");
+		 continue;
+	   }
 
 	   // step 2: bind socket to an IP addr and port
 	   if (bind(server_socket, p->ai_addr, p->ai_addrlen) == -1) {
@@ -588,7 +2712,6 @@ int accept_client(int serv_sock) {
 	int reply_sock_fd = -1;
 	socklen_t sin_size = sizeof(struct sockaddr_storage);
 	struct sockaddr_storage client_addr;
-	char client_printable_addr[INET6_ADDRSTRLEN];
 
 	// accept a connection request from a client
 	// the returned file descriptor from accept will be used
@@ -598,15 +2721,21 @@ int accept_client(int serv_sock) {
 			printf("socket accept error\n");
 	}
 	else {
-		// here is only info only, not really needed.
-		inet_ntop(client_addr.ss_family, get_in_addr((struct sockaddr *)&client_addr), 
-						  client_printable_addr, sizeof client_printable_addr);
-		printf("server: connection from %s at port %d\n", client_printable_addr,
-							((struct sockaddr_in*)&client_addr)->sin_port);
+		print_client(&client_addr);
 	}
 	return reply_sock_fd;
 }
 
+void print_client(struct sockaddr_storage *client_addr) {
+	char client_printable_addr[INET6_ADDRSTRLEN];
+
+	// here is only info only, not really needed.
+	inet_ntop(client_addr->ss_family, get_in_addr((struct sockaddr *)client_addr), 
+					  client_printable_addr, sizeof client_printable_addr);
+	printf("server: connection from %s at port %d\n", client_printable_addr,
+						((struct sockaddr_in*)client_addr)->sin_port);
+}
+
 /* the following is a function designed for testing.
    it prints the ip address and port returned from
    getaddrinfo() function */
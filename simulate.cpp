@@ -0,0 +1,261 @@
+/*
+*	Headless self-play: plays games between two bots entirely in memory, on
+*	every core, and reports how fast and how they ended.
+*
+*	A move goes through the same check as in play_match(),
+*	Board::check_move(): a square off the board or already taken is turned
+*	down and the player asked again, and the game ends on the first line or
+*	a full board, by OUTCOMES. The
+*	players are
+*		random     a free square at random
+*		noisy      any row and column from -1 to 3, so some are turned down
+*		solver     the bot seat's perfect-play search
+*		tablebase  the moves in the tablebase given with -T
+*
+*	Game i draws its random numbers from the seed and i alone, so the same
+*	seed gives the same games however many threads play them. Besides the
+*	totals, a fingerprint adds up a hash of every game's moves: the same
+*	seed and players give the same fingerprint until a rule changes.
+*
+*		g++ -std=c++20 -O2 -pthread simulate.cpp -o simulate
+*		./simulate [-n games] [-x player] [-o player] [-s seed] [-j threads] [-T tablebase]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "board.h"
+#include "outcome.h"
+#include "solver.h"
+#include "tablebase.h"
+
+#define GAMES 1000000
+
+enum { RANDOM, NOISY, SOLVER, TABLEBASE, PLAYERS };
+
+const char *player_names[PLAYERS] = {"random", "noisy", "solver", "tablebase"};
+
+typedef struct SimData {
+   int id;
+   long first;                //games first to last - 1
+   long last;
+   pthread_t thread;
+   Solver *solver;
+   long results[4];           //by Outcome
+   long lengths[10];          //games by the marks on the final board
+   long rejected;             //moves turned down
+   uint64_t fingerprint;
+   char pad[64];              //keep each thread's totals on its own line
+} Sim;
+
+void *sim_loop(void *arg);
+Outcome play_game(Sim *s, long game);
+void pick_move(Sim *s, int player, Board *board, uint64_t *rng, char *x, char *y);
+int player_by_name(const char *name);
+uint64_t splitmix(uint64_t *state);
+double now_seconds();
+
+int players[2] = {RANDOM, RANDOM}; //X's then O's
+uint64_t seed = 1;
+Tablebase tablebase;
+
+int main(int argc, char *argv[]) {
+	long games = GAMES;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	char *tablebase_file = NULL;
+	Sim *sims;
+	long results[4] = {0}, lengths[10] = {0}, rejected = 0, moves = 0, played;
+	uint64_t fingerprint = 0;
+	double start, elapsed;
+	int i, j;
+
+	for(i = 1; i < argc; i = i + 1) {
+		if(i + 1 >= argc) {
+			printf("Usage: %s [-n games] [-x player] [-o player] [-s seed] [-j threads] [-T tablebase]\n",
+			       argv[0]);
+			exit(1);
+		}
+		if(strcmp("-n", argv[i]) == 0) {
+			games = atol(argv[i + 1]);
+		} else if(strcmp("-x", argv[i]) == 0) {
+			players[0] = player_by_name(argv[i + 1]);
+		} else if(strcmp("-o", argv[i]) == 0) {
+			players[1] = player_by_name(argv[i + 1]);
+		} else if(strcmp("-s", argv[i]) == 0) {
+			seed = strtoull(argv[i + 1], NULL, 0);
+		} else if(strcmp("-j", argv[i]) == 0) {
+			threads = atoi(argv[i + 1]);
+		} else if(strcmp("-T", argv[i]) == 0) {
+			tablebase_file = argv[i + 1];
+		}
+		i = i + 1;
+	}
+	if(threads < 1) {
+		threads = 1;
+	}
+	if(players[0] == TABLEBASE || players[1] == TABLEBASE) {
+		if(tablebase_file == NULL || tablebase.open(tablebase_file) == -1) {
+			printf("The tablebase player needs a tablebase file, given with -T.\n");
+			exit(1);
+		}
+	}
+
+	sims = (Sim *)calloc(threads, sizeof(Sim));
+	if(sims == NULL) {
+		printf("Out of memory for threads.\n");
+		exit(1);
+	}
+
+	start = now_seconds();
+	for(i = 0; i < threads; i = i + 1) {
+		sims[i].id = i;
+		sims[i].first = games * i / threads;
+		sims[i].last = games * (i + 1) / threads;
+		sims[i].solver = new Solver();
+		if(pthread_create(&sims[i].thread, NULL, sim_loop, &sims[i]) != 0) {
+			printf("Unable to start thread %d.\n", i);
+			exit(1);
+		}
+	}
+	for(i = 0; i < threads; i = i + 1) {
+		pthread_join(sims[i].thread, NULL);
+	}
+	elapsed = now_seconds() - start;
+
+	for(i = 0; i < threads; i = i + 1) {
+		for(j = 0; j < 4; j = j + 1) {
+			results[j] = results[j] + sims[i].results[j];
+		}
+		for(j = 0; j < 10; j = j + 1) {
+			lengths[j] = lengths[j] + sims[i].lengths[j];
+			moves = moves + j * sims[i].lengths[j];
+		}
+		rejected = rejected + sims[i].rejected;
+		fingerprint = fingerprint + sims[i].fingerprint;
+		delete sims[i].solver;
+	}
+	played = results[X_WINS] + results[O_WINS] + results[DRAW];
+	if(played == 0) {
+		printf("No games played.\n");
+		return 0;
+	}
+
+	printf("%s (X) vs %s (O), seed %llu: %ld games on %d threads in %.3f s, %.0f games/s\n",
+	       player_names[players[0]], player_names[players[1]], (unsigned long long)seed, played, threads,
+	       elapsed, played / elapsed);
+	printf("  X wins %ld (%.2f%%), O wins %ld (%.2f%%), draws %ld (%.2f%%)\n",
+	       results[X_WINS], 100.0 * results[X_WINS] / played, results[O_WINS], 100.0 * results[O_WINS] / played,
+	       results[DRAW], 100.0 * results[DRAW] / played);
+	printf("  %.3f marks a game, %ld moves turned down; games by marks:", (double)moves / played, rejected);
+	for(j = 5; j < 10; j = j + 1) {
+		printf(" %d:%ld", j, lengths[j]);
+	}
+	printf("\n  fingerprint %016llx\n", (unsigned long long)fingerprint);
+
+	return 0;
+}
+
+void *sim_loop(void *arg) {
+	Sim *s = (Sim *)arg;
+	long game;
+
+	for(game = s->first; game < s->last; game = game + 1) {
+		s->results[play_game(s, game)]++;
+	}
+	return NULL;
+}
+
+/*
+*	Plays one game the way play_match() does, without the sockets, and adds
+*	it to the thread's totals
+*/
+Outcome play_game(Sim *s, long game) {
+	uint64_t rng = seed ^ (uint64_t)game * 0x9e3779b97f4a7c15ULL;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	Outcome outcome = IN_PLAY;
+	Board board;
+	int turn = 1;
+	char x, y;
+
+	while(outcome == IN_PLAY) {
+		pick_move(s, players[turn - 1], &board, &rng, &x, &y);
+
+		//first, make sure the input is valid
+		if(board.check_move(x, y) != Board::MOVE_OK) {
+			s->rejected++;
+			continue;
+		}
+
+		board.play(3*x + y, turn == 1 ? 'X' : 'O');
+		hash = (hash ^ (3*x + y)) * 0x100000001b3ULL;
+		outcome = OUTCOMES.status(board);
+		turn = 3 - turn;
+	}
+
+	s->lengths[board.moves()]++;
+	s->fingerprint = s->fingerprint + hash;
+	return outcome;
+}
+
+/*
+*	The row and column player would send for board
+*/
+void pick_move(Sim *s, int player, Board *board, uint64_t *rng, char *x, char *y) {
+	int free_squares[9];
+	int n = 0, sq;
+
+	switch(player) {
+	case NOISY:
+		*x = splitmix(rng) % 5 - 1;
+		*y = splitmix(rng) % 5 - 1;
+		return;
+	case SOLVER:
+		sq = s->solver->best_move(*board);
+		break;
+	case TABLEBASE:
+		sq = tablebase.best_move(*board);
+		break;
+	default:
+		for(sq = 0; sq < 9; sq = sq + 1) {
+			if(!board->taken(sq)) {
+				free_squares[n++] = sq;
+			}
+		}
+		sq = free_squares[splitmix(rng) % n];
+		break;
+	}
+	*x = sq / 3;
+	*y = sq % 3;
+}
+
+int player_by_name(const char *name) {
+	int i;
+
+	for(i = 0; i < PLAYERS; i = i + 1) {
+		if(strcmp(name, player_names[i]) == 0) {
+			return i;
+		}
+	}
+	printf("Unknown player %s: random, noisy, solver or tablebase.\n", name);
+	exit(1);
+}
+
+/*
+*	Steele, Lea and Flood's SplitMix64: the next random number from state
+*/
+uint64_t splitmix(uint64_t *state) {
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
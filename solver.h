@@ -0,0 +1,143 @@
+//////////////////////////////////////////////////////////
+// C++ class for a perfect-play tic-tac-toe searcher
+
+// Filename:     solver.h
+//////////////////////////////////////////////////////////
+// Alpha-beta negamax over Boards with a transposition
+// table. Positions are stored by their canonical board
+// (board.h), so the 8 images of a position share one
+// entry, with its best move kept in canonical squares and
+// mapped back for whichever image is being searched. That
+// leaves 765 positions a game can reach, which fit a
+// 2048-slot table with few collisions; a slot holds its
+// key and a colliding position just replaces it.
+//
+// Scores are from the side to move: 0 for a draw,
+// otherwise 10 less the marks on the board when the game
+// ends, so a quick win beats a slow one and a slow loss
+// beats a quick one. Since a score only depends on the
+// position, entries stay valid from one search to the
+// next; once the table is warm a move takes a few loads.
+//
+// A Solver is 16KB and not thread safe; keep one per
+// thread.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Solver_H
+#define _ooipc_Solver_H
+
+#include <stdint.h>
+#include <string.h>
+#include "board.h"
+#include "outcome.h"
+
+class Solver {
+public:
+  long nodes;                  // positions searched, for benchmarks
+
+  Solver();
+  inline int best_move(const Board &b);
+  inline int score(const Board &b);
+  inline void clear();
+private:
+  enum { NONE = 0, EXACT = 1, LOWER = 2, UPPER = 3, INF = 100 };
+  enum { SLOTS = 2048 };
+  struct Entry {
+    uint32_t key;              // canonical X mask << 9 | O mask
+    int8_t score;
+    uint8_t bound;             // NONE for an empty entry
+    int8_t move;               // best or first refuting square, canonical
+  };
+  Entry table[SLOTS];
+
+  inline int search(const Board &b, int alpha, int beta);
+  inline Entry *probe(uint32_t key);
+};
+
+inline Solver::Solver() {
+  clear();
+}
+
+// Forgets every position searched so far.
+void Solver::clear() {
+  memset(table, 0, sizeof(table));
+  nodes = 0;
+}
+
+// The square the side to move should take, or -1 if the
+// game is already over.
+int Solver::best_move(const Board &b) {
+  int t;
+  Board c = b.canonical(&t);
+
+  if (OUTCOMES.status(b) != IN_PLAY) return -1;
+  search(b, -INF, INF);
+  return Board::unmap_square(probe((uint32_t)c.x << 9 | c.o)->move, t);
+}
+
+// The position's score for the side to move.
+int Solver::score(const Board &b) {
+  return search(b, -INF, INF);
+}
+
+// The slot for a canonical position, emptied if another
+// position had it.
+Solver::Entry *Solver::probe(uint32_t key) {
+  Entry *e = &table[(key * 2654435761u) >> 21 & (SLOTS - 1)];
+
+  if (e->key != key) {
+    e->key = key;
+    e->bound = NONE;
+  }
+  return e;
+}
+
+int Solver::search(const Board &b, int alpha, int beta) {
+  Outcome status = OUTCOMES.status(b);
+  char symbol = b.moves() % 2 == 0 ? 'X' : 'O';
+  int alpha0 = alpha;
+  int best = -INF, best_move = -1;
+  int order[9], n = 0;
+  int sq, v, t;
+  Board c;
+  Entry *e;
+
+  nodes++;
+  if (status == DRAW) return 0;
+  if (status != IN_PLAY) return -(10 - b.moves()); // the last move won
+
+  c = b.canonical(&t);
+  e = probe((uint32_t)c.x << 9 | c.o);
+  if (e->bound == EXACT) return e->score;
+  if (e->bound == LOWER && e->score >= beta) return e->score;
+  if (e->bound == UPPER && e->score <= alpha) return e->score;
+
+  //the move that was best or cut off last time goes first
+  if (e->bound != NONE) order[n++] = Board::unmap_square(e->move, t);
+  for (sq = 0; sq < 9; sq++) {
+    if (!b.taken(sq) && (n == 0 || sq != order[0])) order[n++] = sq;
+  }
+
+  for (int i = 0; i < n; i++) {
+    Board next = b;
+    sq = order[i];
+    next.play(sq, symbol);
+    v = -search(next, -beta, -alpha);
+    if (v > best) {
+      best = v;
+      best_move = sq;
+    }
+    if (best > alpha) alpha = best;
+    if (alpha >= beta) break;
+  }
+
+  //children may have taken the slot, so look again
+  e = probe((uint32_t)c.x << 9 | c.o);
+  e->score = best;
+  e->move = Board::map_square(best_move, t);
+  if (best <= alpha0) e->bound = UPPER;
+  else if (best >= beta) e->bound = LOWER;
+  else e->bound = EXACT;
+  return best;
+}
+#endif
@@ -0,0 +1,309 @@
+/*
+*	Builds the tablebase (tablebase.h): the perfect-play result, moves left
+*	and best move of every canonical position a game of tic-tac-toe can
+*	reach, written to a file the server and bots map read-only.
+*
+*	Positions are solved by retrograde analysis, from full boards back to
+*	the empty one. Each layer of positions with the same number of marks
+*	only needs the layer after it, so a layer is split over the threads
+*	and finished before the next one starts. Every result is then checked
+*	against the solver before the file is written; it is written to a
+*	temporary file and renamed over the old one, so a server never maps
+*	half a tablebase.
+*
+*		g++ -std=c++20 -O2 -pthread tablebase.cpp -o tablebase
+*		./tablebase <file> [-j threads]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "board.h"
+#include "outcome.h"
+#include "solver.h"
+#include "tablebase.h"
+
+#define KEYS (1 << 18)         //every X mask << 9 | O mask
+#define LAYERS 10              //marks on the board, 0 to 9
+
+typedef struct LayerWorkData {
+   int layer;
+   int id;
+   int threads;
+   pthread_t thread;
+} LayerWork;
+
+void collect_positions();
+void solve_layer(int layer, int threads);
+void *solve_share(void *arg);
+void solve_position(uint32_t key);
+int check_with_solver();
+int write_tablebase(const char *path);
+double now_seconds();
+
+TablebaseEntry by_key[KEYS];   //the results so far, by key
+uint8_t solved[KEYS];          //set once by_key[key] holds a result; a byte each, so threads never share one
+uint32_t *layer_keys[LAYERS];  //the canonical positions with each number of marks
+int layer_count[LAYERS];
+TablebaseEntry *entries = NULL; //the file's entries, in key order
+uint32_t entry_count = 0;
+
+int main(int argc, char *argv[]) {
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int layer, i, wrong;
+	double start;
+
+	if(argc < 2) {
+		printf("Usage: %s <file> [-j threads]\n", argv[0]);
+		exit(1);
+	}
+	for(i = 2; i < argc; i = i + 1) {
+		if(strcmp("-j", argv[i]) == 0 && i + 1 < argc) {
+			i = i + 1;
+			threads = atoi(argv[i]);
+		}
+	}
+	if(threads < 1) {
+		threads = 1;
+	}
+
+	start = now_seconds();
+	collect_positions();
+	for(layer = LAYERS - 1; layer >= 0; layer = layer - 1) {
+		solve_layer(layer, threads);
+	}
+
+	for(layer = 0; layer < LAYERS; layer = layer + 1) {
+		entry_count = entry_count + layer_count[layer];
+	}
+	entries = (TablebaseEntry *)calloc(entry_count, sizeof(TablebaseEntry));
+	if(entries == NULL) {
+		printf("Out of memory for entries.\n");
+		exit(1);
+	}
+	//in key order, for the binary search
+	entry_count = 0;
+	for(i = 0; i < KEYS; i = i + 1) {
+		if(solved[i]) {
+			entries[entry_count] = by_key[i];
+			entry_count = entry_count + 1;
+		}
+	}
+	printf("Solved %u positions on %d threads in %.2f ms.\n", entry_count, threads,
+	       (now_seconds() - start)*1e3);
+
+	if((wrong = check_with_solver()) != 0) {
+		printf("%d positions disagree with the solver, not writing %s.\n", wrong, argv[1]);
+		exit(1);
+	}
+
+	if(write_tablebase(argv[1]) == -1) {
+		printf("Unable to write %s: %s\n", argv[1], strerror(errno));
+		exit(1);
+	}
+	printf("Wrote %s: %zu bytes, version %d.\n", argv[1],
+	       sizeof(TablebaseHeader) + entry_count*sizeof(TablebaseEntry), TABLEBASE_VERSION);
+
+	return 0;
+}
+
+/*
+*	Lists every canonical position a game can reach, by how many marks it
+*	has, finished games included
+*/
+void collect_positions() {
+	uint32_t x, o;
+	Board b, c;
+	int t, n;
+
+	for(x = 0; x < 512; x = x + 1) {
+		for(o = 0; o < 512; o = o + 1) {
+			if(x & o) {
+				continue;
+			}
+			b.x = x;
+			b.o = o;
+			c = b.canonical(&t);
+			if(c.x != b.x || c.o != b.o || !OUTCOMES.reachable(OUTCOMES.index(b))) {
+				continue;
+			}
+
+			n = b.moves();
+			if(layer_count[n] % 64 == 0) {
+				layer_keys[n] = (uint32_t *)realloc(layer_keys[n], (layer_count[n] + 64)*sizeof(uint32_t));
+				if(layer_keys[n] == NULL) {
+					printf("Out of memory for positions.\n");
+					exit(1);
+				}
+			}
+			layer_keys[n][layer_count[n]] = x << 9 | o;
+			layer_count[n] = layer_count[n] + 1;
+		}
+	}
+}
+
+/*
+*	Solves every position in a layer, a share of them on each thread. The
+*	layer after it is already done and is only read.
+*/
+void solve_layer(int layer, int threads) {
+	LayerWork *work = (LayerWork *)calloc(threads, sizeof(LayerWork));
+	int i;
+
+	if(work == NULL) {
+		printf("Out of memory for threads.\n");
+		exit(1);
+	}
+
+	for(i = 0; i < threads; i = i + 1) {
+		work[i].layer = layer;
+		work[i].id = i;
+		work[i].threads = threads;
+		if(i > 0 && pthread_create(&work[i].thread, NULL, solve_share, &work[i]) != 0) {
+			printf("Unable to start thread %d.\n", i);
+			exit(1);
+		}
+	}
+	solve_share(&work[0]);
+	for(i = 1; i < threads; i = i + 1) {
+		pthread_join(work[i].thread, NULL);
+	}
+	free(work);
+}
+
+void *solve_share(void *arg) {
+	LayerWork *work = (LayerWork *)arg;
+	int i;
+
+	for(i = work->id; i < layer_count[work->layer]; i = i + work->threads) {
+		solve_position(layer_keys[work->layer][i]);
+	}
+	return NULL;
+}
+
+/*
+*	Works out a canonical position from its children: a win if any child
+*	is a loss for the opponent, taking the quickest, otherwise a draw if
+*	any child is one, otherwise a loss, taking the slowest
+*/
+void solve_position(uint32_t key) {
+	TablebaseEntry *e = &by_key[key];
+	TablebaseEntry *child;
+	Board b, next, c;
+	Outcome status;
+	char symbol;
+	int sq, t, result, distance;
+
+	b.x = key >> 9;
+	b.o = key & Board::FULL;
+	status = OUTCOMES.status(b);
+
+	e->key = key;
+	e->move = Tablebase::NO_MOVE;
+	e->distance = 0;
+	e->pad = 0;
+	solved[key] = 1;
+	if(status == DRAW) {
+		e->result = TB_DRAW;
+		return;
+	}
+	if(status != IN_PLAY) {
+		e->result = TB_LOSS; //the last move won
+		return;
+	}
+
+	symbol = b.moves() % 2 == 0 ? 'X' : 'O';
+	for(sq = 0; sq < 9; sq = sq + 1) {
+		if(b.taken(sq)) {
+			continue;
+		}
+		next = b;
+		next.play(sq, symbol);
+		c = next.canonical(&t);
+		child = &by_key[(uint32_t)c.x << 9 | c.o];
+
+		result = TB_WIN - child->result;
+		distance = child->distance + 1;
+		if(e->move == Tablebase::NO_MOVE || result > e->result ||
+		   (result == e->result && result == TB_WIN && distance < e->distance) ||
+		   (result == e->result && result == TB_LOSS && distance > e->distance)) {
+			e->move = sq; //b is canonical, so this is a canonical square
+			e->result = result;
+			e->distance = distance;
+		}
+	}
+}
+
+/*
+*	Counts the entries whose result, or for a decided game the number of
+*	moves left, is not what the solver's score says. A solver score is 10
+*	less the marks on the board when the game ends.
+*/
+int check_with_solver() {
+	Solver solver;
+	Board b;
+	uint32_t i;
+	int score, wrong = 0;
+
+	for(i = 0; i < entry_count; i = i + 1) {
+		b.x = entries[i].key >> 9;
+		b.o = entries[i].key & Board::FULL;
+		score = solver.score(b);
+		if(score == 0 && entries[i].result != TB_DRAW) {
+			wrong = wrong + 1;
+		} else if(score > 0 && (entries[i].result != TB_WIN ||
+		                        entries[i].distance != 10 - score - b.moves())) {
+			wrong = wrong + 1;
+		} else if(score < 0 && (entries[i].result != TB_LOSS ||
+		                        entries[i].distance != 10 + score - b.moves())) {
+			wrong = wrong + 1;
+		}
+	}
+	return wrong;
+}
+
+/*
+*	Writes the header and entries to path.tmp, syncs it and renames it over
+*	path. Returns 0, or -1 with errno set.
+*/
+int write_tablebase(const char *path) {
+	TablebaseHeader h;
+	char tmp[4096];
+	int fd, saved;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TABLEBASE_MAGIC, sizeof(h.magic));
+	h.version = TABLEBASE_VERSION;
+	h.rows = 3;
+	h.cols = 3;
+	h.win = 3;
+	h.entry_size = sizeof(TablebaseEntry);
+	h.count = entry_count;
+	h.checksum = tablebase_checksum(entries, entry_count);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		return -1;
+	}
+	if(write(fd, &h, sizeof(h)) != sizeof(h) ||
+	   write(fd, entries, entry_count*sizeof(TablebaseEntry)) != (ssize_t)(entry_count*sizeof(TablebaseEntry)) ||
+	   fsync(fd) == -1) {
+		saved = errno;
+		close(fd);
+		unlink(tmp);
+		errno = saved;
+		return -1;
+	}
+	close(fd);
+	return rename(tmp, path);
+}
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
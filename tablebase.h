@@ -0,0 +1,185 @@
+//////////////////////////////////////////////////////////
+// C++ class for reading a tic-tac-toe tablebase file
+
+// Filename:     tablebase.h
+//////////////////////////////////////////////////////////
+// A tablebase holds the perfect-play result of every
+// position a game can reach, as worked out once by the
+// tablebase tool (tablebase.cpp), so answering a move is
+// a lookup rather than a search. Only canonical positions
+// (board.h) are stored, 765 of them for 3x3, with the
+// best move in canonical squares to be mapped back.
+//
+// The file is a TablebaseHeader and then its entries,
+// sorted by key for a binary search. open() maps it
+// read-only, so every process that opens the same file
+// shares the one copy in the page cache and starting up
+// costs a system call or two whatever the size. The
+// header names the game it is for and carries a version
+// and a checksum of the entries; a file that does not
+// match is refused rather than trusted.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Tablebase_H
+#define _ooipc_Tablebase_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "board.h"
+
+#define TABLEBASE_MAGIC "TTTBASE"
+#define TABLEBASE_VERSION 1
+
+enum TablebaseResult : uint8_t { TB_LOSS = 0, TB_DRAW = 1, TB_WIN = 2 };
+
+struct TablebaseHeader {
+  char magic[8];               // TABLEBASE_MAGIC
+  uint32_t version;            // TABLEBASE_VERSION
+  uint8_t rows, cols, win;     // the game: 3, 3, 3
+  uint8_t entry_size;          // sizeof(TablebaseEntry)
+  uint32_t count;              // entries after the header
+  uint32_t checksum;           // tablebase_checksum() of the entries
+};
+
+struct TablebaseEntry {
+  uint32_t key;                // canonical X mask << 9 | O mask
+  uint8_t move;                // best square, canonical; NO_MOVE once over
+  uint8_t result;              // TablebaseResult for the side to move
+  uint8_t distance;            // moves left in the game under perfect play
+  uint8_t pad;
+};
+
+static_assert(sizeof(TablebaseHeader) == 24 && sizeof(TablebaseEntry) == 8,
+              "the file layout must not depend on the compiler");
+
+// FNV-1a over the entries' bytes.
+inline uint32_t tablebase_checksum(const TablebaseEntry *entries, uint32_t count) {
+  const uint8_t *p = (const uint8_t *)entries;
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i < (size_t)count * sizeof(TablebaseEntry); i++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+class Tablebase {
+public:
+  static constexpr uint8_t NO_MOVE = 0xff;
+
+  Tablebase();
+  ~Tablebase();
+  inline int open(const char *path);
+  inline void close();
+  inline int loaded() const;
+  inline uint32_t count() const;
+  inline const TablebaseEntry *find(const Board &b, int *t) const;
+  inline int best_move(const Board &b) const;
+  inline int result(const Board &b, int *distance) const;
+private:
+  void *map;
+  size_t map_len;
+  const TablebaseEntry *entries;
+  uint32_t entry_count;
+};
+
+inline Tablebase::Tablebase(): map(NULL), map_len(0), entries(NULL), entry_count(0) {
+}
+
+inline Tablebase::~Tablebase() {
+  close();
+}
+
+// Maps the file at path. Returns 0, or -1 if it cannot be
+// read or is not a 3x3 tablebase of this version.
+int Tablebase::open(const char *path) {
+  const TablebaseHeader *h;
+  struct stat st;
+  int fd;
+
+  close();
+  if ((fd = ::open(path, O_RDONLY | O_CLOEXEC)) == -1) return -1;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(TablebaseHeader)) {
+    ::close(fd);
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    map = NULL;
+    return -1;
+  }
+  map_len = st.st_size;
+
+  h = (const TablebaseHeader *)map;
+  entries = (const TablebaseEntry *)(h + 1);
+  entry_count = h->count;
+  if (memcmp(h->magic, TABLEBASE_MAGIC, sizeof(h->magic)) != 0 || h->version != TABLEBASE_VERSION ||
+      h->rows != 3 || h->cols != 3 || h->win != 3 || h->entry_size != sizeof(TablebaseEntry) ||
+      map_len != sizeof(TablebaseHeader) + (size_t)h->count * sizeof(TablebaseEntry) ||
+      tablebase_checksum(entries, entry_count) != h->checksum) {
+    close();
+    return -1;
+  }
+  return 0;
+}
+
+void Tablebase::close() {
+  if (map != NULL) munmap(map, map_len);
+  map = NULL;
+  map_len = 0;
+  entries = NULL;
+  entry_count = 0;
+}
+
+int Tablebase::loaded() const {
+  return entries != NULL;
+}
+
+uint32_t Tablebase::count() const {
+  return entry_count;
+}
+
+// The entry for b's canonical position, found by binary
+// search, with the transform that got there in *t; NULL
+// if b cannot come up in a game.
+const TablebaseEntry *Tablebase::find(const Board &b, int *t) const {
+  Board c = b.canonical(t);
+  uint32_t key = (uint32_t)c.x << 9 | c.o;
+  uint32_t lo = 0, hi = entry_count;
+
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (entries[mid].key < key) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == entry_count || entries[lo].key != key) return NULL;
+  return &entries[lo];
+}
+
+// The square the side to move should take, or -1 if the
+// game is over or the position is not in the table.
+int Tablebase::best_move(const Board &b) const {
+  int t;
+  const TablebaseEntry *e = find(b, &t);
+
+  if (e == NULL || e->move == NO_MOVE) return -1;
+  return Board::unmap_square(e->move, t);
+}
+
+// The TablebaseResult for the side to move, with the
+// moves left under perfect play in *distance, or -1 if
+// the position is not in the table.
+int Tablebase::result(const Board &b, int *distance) const {
+  int t;
+  const TablebaseEntry *e = find(b, &t);
+
+  if (e == NULL) return -1;
+  if (distance != NULL) *distance = e->distance;
+  return e->result;
+}
+#endif
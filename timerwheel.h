@@ -0,0 +1,192 @@
+//////////////////////////////////////////////////////////
+// C++ class for a hierarchical timer wheel
+
+// Filename:     timerwheel.h
+//////////////////////////////////////////////////////////
+// Time is counted in ticks of whatever length the owner
+// picks. A timer due within 256 ticks sits in the slot of
+// the first wheel for its tick; later ones sit in coarser
+// wheels, each slot of which covers a whole lap of the
+// wheel below, and are moved down a level whenever that
+// lap comes round. Timers are linked into their slot in
+// place, so add() and cancel() are O(1) and cost no
+// allocation however many timers are armed, and
+// advance() only looks at the slots for the ticks that
+// went by.
+//
+// Timers are owned by the caller, must start out zeroed
+// and must stay put while they are armed. A timer can be
+// added or cancelled from inside another one's fire().
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_TimerWheel_H
+#define _ooipc_TimerWheel_H
+
+#include <stddef.h>
+
+struct Timer {
+  long expires;                // tick it fires on
+  Timer *prev;
+  Timer *next;                 // NULL while it is not armed
+  void (*fire)(Timer *t);
+  void *data;
+};
+
+class TimerWheel {
+  enum { BITS = 8, SLOTS = 1 << BITS, MASK = SLOTS - 1, LEVELS = 4 };
+  Timer slot[LEVELS][SLOTS];   // list heads
+  long now;                    // next tick to run
+  long count;
+
+  inline void link(Timer *head, Timer *t);
+  inline void unlink(Timer *t);
+  inline void place(Timer *t);
+  inline void cascade(int level);
+public:
+  TimerWheel(long tick);
+  inline void add(Timer *t, long expires);
+  inline void cancel(Timer *t);
+  inline int armed(Timer *t);
+  inline void advance(long tick);
+  inline long next_expiry();
+  inline long size();
+};
+
+inline TimerWheel::TimerWheel(long tick) {
+  for (int l = 0; l < LEVELS; l++) {
+    for (int i = 0; i < SLOTS; i++) {
+      slot[l][i].prev = slot[l][i].next = &slot[l][i];
+    }
+  }
+  now = tick;
+  count = 0;
+}
+
+void TimerWheel::link(Timer *head, Timer *t) {
+  t->prev = head->prev;
+  t->next = head;
+  head->prev->next = t;
+  head->prev = t;
+}
+
+void TimerWheel::unlink(Timer *t) {
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->prev = t->next = NULL;
+}
+
+// Files t under the wheel whose slots are just coarse
+// enough to hold how far off it is.
+void TimerWheel::place(Timer *t) {
+  long delta;
+  int l = 0;
+
+  if (t->expires < now) t->expires = now;
+  delta = t->expires - now;
+  if (delta >= 1L << (BITS*LEVELS)) {
+    t->expires = now + (1L << (BITS*LEVELS)) - 1;
+    delta = t->expires - now;
+  }
+  while (l < LEVELS - 1 && delta >= 1L << (BITS*(l + 1))) l++;
+  link(&slot[l][(t->expires >> (BITS*l)) & MASK], t);
+}
+
+// Moves the slot of this level that the current lap has
+// reached down to the finer wheels.
+void TimerWheel::cascade(int level) {
+  int i = (now >> (BITS*level)) & MASK;
+  Timer *head = &slot[level][i];
+  Timer moving;
+  Timer *t;
+
+  if (head->next == head) {
+    if (i == 0 && level + 1 < LEVELS) cascade(level + 1);
+    return;
+  }
+  moving.prev = head->prev;
+  moving.next = head->next;
+  moving.prev->next = moving.next->prev = &moving;
+  head->prev = head->next = head;
+
+  while ((t = moving.next) != &moving) {
+    unlink(t);
+    place(t);
+  }
+  if (i == 0 && level + 1 < LEVELS) cascade(level + 1);
+}
+
+// Arms t to fire on the given tick, or on the next one
+// advance() runs if that has gone by. An armed timer is
+// moved.
+void TimerWheel::add(Timer *t, long expires) {
+  if (t->next != NULL) {
+    unlink(t);
+  } else {
+    count++;
+  }
+  t->expires = expires;
+  place(t);
+}
+
+void TimerWheel::cancel(Timer *t) {
+  if (t->next != NULL) {
+    unlink(t);
+    count--;
+  }
+}
+
+int TimerWheel::armed(Timer *t) {
+  return t->next != NULL;
+}
+
+// Fires every timer due on or before tick, in order.
+void TimerWheel::advance(long tick) {
+  Timer due;
+  Timer *t;
+  int i;
+
+  if (count == 0) {
+    if (tick >= now) now = tick + 1;
+    return;
+  }
+  while (now <= tick) {
+    i = now & MASK;
+    if (i == 0) cascade(1);
+
+    //take the whole slot first so fire() can change the wheel
+    due.prev = due.next = &due;
+    if (slot[0][i].next != &slot[0][i]) {
+      due.prev = slot[0][i].prev;
+      due.next = slot[0][i].next;
+      due.prev->next = due.next->prev = &due;
+      slot[0][i].prev = slot[0][i].next = &slot[0][i];
+    }
+    now++;
+
+    while ((t = due.next) != &due) {
+      unlink(t);
+      count--;
+      t->fire(t);
+    }
+  }
+}
+
+// A tick no later than the next timer is due, for
+// working out how long to sleep, or -1 if none is armed.
+// It is exact for timers within 256 ticks.
+long TimerWheel::next_expiry() {
+  long tick;
+
+  if (count == 0) return -1;
+  for (tick = now; tick < now + SLOTS; tick++) {
+    //the coarser wheels may have timers for any tick of a new lap
+    if ((tick & MASK) == 0) return tick;
+    if (slot[0][tick & MASK].next != &slot[0][tick & MASK]) return tick;
+  }
+  return tick;
+}
+
+long TimerWheel::size() {
+  return count;
+}
+#endif
@@ -0,0 +1,314 @@
+//////////////////////////////////////////////////////////
+// C++ classes for ultimate tic-tac-toe and its bot
+
+// Filename:     ultimate.h
+//////////////////////////////////////////////////////////
+// Ultimate tic-tac-toe is nine boards in a 3x3 grid. A
+// move in square s of a board sends the opponent to board
+// s, or anywhere if board s is closed (won or full).
+// Winning a board takes its square on the meta-board, and
+// a line there wins the game; the game is a draw once
+// every board is closed without one.
+//
+// Squares are given as (sub, sq): the board, numbered 0 to
+// 8 like squares, and the square in it. On the wire they
+// are a row and a column of the 9x9 grid, 0 to 8 each.
+//
+// Everything about the position is kept up to date by
+// play() from the one board the move was on: that board's
+// status is one OUTCOMES load, and only when it closes is
+// the meta-board touched, another load. The evaluation is
+// kept the same way. LINE_SCORES holds a score for every
+// 3x3 position (compile-time, like OUTCOMES), and the
+// evaluation is the sum of the scores of the open boards
+// plus the meta-board's times META_WEIGHT; a move swaps
+// in the new score of its board, and of the meta-board
+// if the board closed.
+//
+// UltimateBot searches with alpha-beta to ever greater
+// depth until it has spent its budget of positions, so a
+// move costs about the same however many are open.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Ultimate_H
+#define _ooipc_Ultimate_H
+
+#include <stdint.h>
+#include "board.h"
+#include "outcome.h"
+
+// A score for every 3x3 position, from X's side: a won
+// position is worth WON, otherwise every line only one
+// side has marks in is worth 1 with one mark and 4 with
+// two.
+struct LineScores {
+  static constexpr int WON = 24;
+  int8_t score[OutcomeTable::POSITIONS];
+
+  constexpr LineScores();
+};
+
+constexpr LineScores::LineScores(): score{} {
+  uint16_t x, o;
+  int i, n, sq, l, xs, os, s;
+
+  for (i = 0; i < OutcomeTable::POSITIONS; i++) {
+    x = o = 0;
+    n = i;
+    for (sq = 0; sq < 9; sq++) {
+      if (n % 3 == 1) x |= 1 << sq;
+      if (n % 3 == 2) o |= 1 << sq;
+      n /= 3;
+    }
+
+    s = 0;
+    for (l = 0; l < 8; l++) {
+      xs = __builtin_popcount(x & Board::LINES[l]);
+      os = __builtin_popcount(o & Board::LINES[l]);
+      if (xs == 3) s = WON;
+      if (os == 3) s = -WON;
+    }
+    for (l = 0; l < 8 && s != WON && s != -WON; l++) {
+      xs = __builtin_popcount(x & Board::LINES[l]);
+      os = __builtin_popcount(o & Board::LINES[l]);
+      if (os == 0 && xs > 0) s += xs == 1 ? 1 : 4;
+      if (xs == 0 && os > 0) s -= os == 1 ? 1 : 4;
+    }
+    score[i] = s;
+  }
+}
+
+inline constexpr LineScores LINE_SCORES;
+
+class UltimateBoard {
+public:
+  static constexpr int ANY = -1;
+  static constexpr int META_WEIGHT = 8;
+
+  Board boards[9];
+  Board meta;                  // boards won by X and by O
+  uint16_t closed;             // boards won or full
+  int8_t next;                 // board the next move must be on, or ANY
+  uint8_t count;
+  Outcome result;
+  int score;                   // the evaluation, from X's side
+
+  UltimateBoard();
+  inline void clear();
+  inline int allowed(int sub) const;
+  inline int taken(int sub, int sq) const;
+  inline Outcome play(int sub, int sq, char symbol);
+  inline char at(int sub, int sq) const;
+  inline char to_move() const;
+  inline void load(const char cells[81], int next_board);
+  static inline int sub_of(int row, int col);
+  static inline int square_of(int row, int col);
+  static inline int row_of(int sub, int sq);
+  static inline int col_of(int sub, int sq);
+private:
+  static inline int board_score(const Board &b);
+};
+
+inline UltimateBoard::UltimateBoard() {
+  clear();
+}
+
+void UltimateBoard::clear() {
+  for (int i = 0; i < 9; i++) boards[i].clear();
+  meta.clear();
+  closed = 0;
+  next = ANY;
+  count = 0;
+  result = IN_PLAY;
+  score = 0;
+}
+
+int UltimateBoard::board_score(const Board &b) {
+  return LINE_SCORES.score[OUTCOMES.index(b)];
+}
+
+// Nonzero if the next move may go on board sub.
+int UltimateBoard::allowed(int sub) const {
+  if ((closed >> sub) & 1) return 0;
+  return next == ANY || next == sub;
+}
+
+int UltimateBoard::taken(int sub, int sq) const {
+  return boards[sub].taken(sq);
+}
+
+// Makes a move allowed() and not taken(), and returns
+// the game's Outcome after it.
+Outcome UltimateBoard::play(int sub, int sq, char symbol) {
+  Board &b = boards[sub];
+  Outcome status;
+  int meta_before;
+
+  score -= board_score(b);
+  b.play(sq, symbol);
+  count++;
+
+  status = OUTCOMES.status(b);
+  if (status == IN_PLAY) {
+    score += board_score(b);
+  } else {
+    //closed: its own score is gone, and a win goes on the meta-board
+    closed |= 1 << sub;
+    if (status != DRAW) {
+      meta_before = board_score(meta);
+      meta.play(sub, symbol);
+      score += META_WEIGHT * (board_score(meta) - meta_before);
+      status = OUTCOMES.status(meta);
+      if (status == X_WINS || status == O_WINS) result = status;
+    }
+  }
+  if (result == IN_PLAY && closed == Board::FULL) result = DRAW;
+
+  next = (closed >> sq) & 1 ? ANY : sq;
+  return result;
+}
+
+char UltimateBoard::at(int sub, int sq) const {
+  return boards[sub].at(sq);
+}
+
+char UltimateBoard::to_move() const {
+  return count % 2 == 0 ? 'X' : 'O';
+}
+
+// Sets the position from the 81 squares of the grid, row
+// by row ('X', 'O' or 0), and the board to move on.
+void UltimateBoard::load(const char cells[81], int next_board) {
+  Outcome status;
+
+  clear();
+  for (int i = 0; i < 81; i++) {
+    if (cells[i] != 0) {
+      boards[sub_of(i / 9, i % 9)].play(square_of(i / 9, i % 9), cells[i]);
+      count++;
+    }
+  }
+  for (int sub = 0; sub < 9; sub++) {
+    status = OUTCOMES.status(boards[sub]);
+    if (status == IN_PLAY) {
+      score += board_score(boards[sub]);
+      continue;
+    }
+    closed |= 1 << sub;
+    if (status != DRAW) meta.play(sub, status == X_WINS ? 'X' : 'O');
+  }
+  score += META_WEIGHT * board_score(meta);
+  status = OUTCOMES.status(meta);
+  if (status == X_WINS || status == O_WINS) result = status;
+  else if (closed == Board::FULL) result = DRAW;
+  next = next_board >= 0 && next_board < 9 && !((closed >> next_board) & 1) ? next_board : ANY;
+}
+
+int UltimateBoard::sub_of(int row, int col) {
+  return 3*(row / 3) + col / 3;
+}
+
+int UltimateBoard::square_of(int row, int col) {
+  return 3*(row % 3) + col % 3;
+}
+
+int UltimateBoard::row_of(int sub, int sq) {
+  return 3*(sub / 3) + sq / 3;
+}
+
+int UltimateBoard::col_of(int sub, int sq) {
+  return 3*(sub % 3) + sq % 3;
+}
+
+class UltimateBot {
+public:
+  enum { BUDGET = 20000 };     // positions searched per move
+  long nodes;                  // in the last best_move()
+
+  UltimateBot();
+  inline int best_move(const UltimateBoard &b);
+private:
+  enum { WIN = 10000, INF = 1 << 20, MAX_DEPTH = 81 };
+  long limit;
+  int out_of_budget;
+
+  inline int search(const UltimateBoard &b, int depth, int alpha, int beta);
+};
+
+inline UltimateBot::UltimateBot(): nodes(0), limit(0), out_of_budget(0) {
+}
+
+// The move for the side to move, as 9*sub + sq, or -1 if
+// the game is over. Each depth is searched in full or not
+// at all: the move kept is from the deepest search that
+// finished within the budget.
+int UltimateBot::best_move(const UltimateBoard &b) {
+  int best = -1, depth_best, sub, sq, v, alpha;
+  uint16_t free_squares;
+
+  if (b.result != IN_PLAY) return -1;
+  nodes = 0;
+  limit = BUDGET;
+  out_of_budget = 0;
+
+  for (int depth = 1; depth <= MAX_DEPTH - b.count && !out_of_budget; depth++) {
+    alpha = -INF;
+    depth_best = -1;
+    for (int i = -1; i < 81 && !out_of_budget; i++) {
+      //last depth's best move first, then the rest
+      int move = i == -1 ? best : i;
+      if (move == -1 || (i >= 0 && move == best)) continue;
+      sub = move / 9;
+      sq = move % 9;
+      free_squares = ~(b.boards[sub].x | b.boards[sub].o) & Board::FULL;
+      if (!b.allowed(sub) || !((free_squares >> sq) & 1)) continue;
+
+      UltimateBoard child = b;
+      child.play(sub, sq, b.to_move());
+      v = -search(child, depth - 1, -INF, -alpha);
+      if (v > alpha || depth_best == -1) {
+        alpha = v;
+        depth_best = move;
+      }
+    }
+    if (!out_of_budget || best == -1) best = depth_best;
+    if (alpha >= WIN - MAX_DEPTH) break; // a forced win; no need to look deeper
+  }
+  return best;
+}
+
+// Negamax from the side to move. Gives up, returning 0,
+// once the budget is spent.
+int UltimateBot::search(const UltimateBoard &b, int depth, int alpha, int beta) {
+  int best = -INF, v, sub, sq, first, last;
+  int sign = b.to_move() == 'X' ? 1 : -1;
+  uint16_t free_squares;
+
+  nodes++;
+  if (nodes > limit) {
+    out_of_budget = 1;
+    return 0;
+  }
+  if (b.result == DRAW) return 0;
+  if (b.result != IN_PLAY) return -(WIN - b.count); // the last move won, sooner is worse
+  if (depth == 0) return sign * b.score;
+
+  first = b.next == UltimateBoard::ANY ? 0 : b.next;
+  last = b.next == UltimateBoard::ANY ? 8 : b.next;
+  for (sub = first; sub <= last; sub++) {
+    if (!b.allowed(sub)) continue;
+    free_squares = ~(b.boards[sub].x | b.boards[sub].o) & Board::FULL;
+    for (sq = 0; sq < 9; sq++) {
+      if (!((free_squares >> sq) & 1)) continue;
+      UltimateBoard child = b;
+      child.play(sub, sq, b.to_move());
+      v = -search(child, depth - 1, -beta, -alpha);
+      if (out_of_budget) return 0;
+      if (v > best) best = v;
+      if (best > alpha) alpha = best;
+      if (alpha >= beta) return best;
+    }
+  }
+  return best;
+}
+#endif
@@ -0,0 +1,229 @@
+//////////////////////////////////////////////////////////
+// C++ class for a Linux io_uring instance
+
+// Filename:     uring.h
+//////////////////////////////////////////////////////////
+// Talks to the kernel through the raw io_uring_setup()
+// and io_uring_enter() system calls, so no liburing is
+// needed. Requests are prepared into the submission ring
+// and handed to the kernel together by submit_and_wait();
+// results are read back with peek() and seen(). With a
+// timeout the wait also ends when the time is up, which
+// needs a 5.11 or later kernel (has_timeouts()).
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Uring_H
+#define _ooipc_Uring_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+class Uring {
+  int fd;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  unsigned sq_entries;
+  unsigned to_submit;
+  unsigned features;
+  void *sq_ptr;
+  void *cq_ptr;
+  size_t sq_size;
+  size_t cq_size;
+  size_t sqes_size;
+  inline struct io_uring_sqe *get_sqe();
+public:
+  Uring(unsigned entries);
+  ~Uring();
+  inline int ok();
+  inline int has_timeouts();
+  inline void prep_recv(int sock, void *buf, unsigned len, __u64 data);
+  inline void prep_send(int sock, const void *buf, unsigned len, __u64 data);
+  inline void prep_read(int file, void *buf, unsigned len, __u64 data);
+  inline void prep_accept(int sock, struct sockaddr *addr, socklen_t *len, __u64 data);
+  inline int submit_and_wait(unsigned wait_nr, long timeout_ms = -1);
+  inline struct io_uring_cqe *peek();
+  inline void seen();
+};
+
+inline Uring::Uring(unsigned entries) {
+  struct io_uring_params p;
+
+  memset(&p, 0, sizeof(p));
+  sq_ptr = cq_ptr = MAP_FAILED;
+  sqes = (struct io_uring_sqe *)MAP_FAILED;
+  to_submit = 0;
+  features = 0;
+
+  fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd == -1) {
+    perror("Uring->io_uring_setup()");
+    return;
+  }
+
+  features = p.features;
+  sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  cq_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cq_size > sq_size) sq_size = cq_size;
+    cq_size = sq_size;
+  }
+
+  sq_ptr = mmap(0, sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                fd, IORING_OFF_SQ_RING);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ptr = sq_ptr;
+  } else {
+    cq_ptr = mmap(0, cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                  fd, IORING_OFF_CQ_RING);
+  }
+  sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+  sqes = (struct io_uring_sqe *)mmap(0, sqes_size, PROT_READ|PROT_WRITE,
+                                     MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+    perror("Uring->mmap()");
+    close(fd);
+    fd = -1;
+    return;
+  }
+
+  sq_head = (unsigned *)((char *)sq_ptr + p.sq_off.head);
+  sq_tail = (unsigned *)((char *)sq_ptr + p.sq_off.tail);
+  sq_mask = (unsigned *)((char *)sq_ptr + p.sq_off.ring_mask);
+  sq_array = (unsigned *)((char *)sq_ptr + p.sq_off.array);
+  sq_entries = p.sq_entries;
+  cq_head = (unsigned *)((char *)cq_ptr + p.cq_off.head);
+  cq_tail = (unsigned *)((char *)cq_ptr + p.cq_off.tail);
+  cq_mask = (unsigned *)((char *)cq_ptr + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)((char *)cq_ptr + p.cq_off.cqes);
+}
+
+inline Uring::~Uring() {
+  if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+  if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+  if (sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_size);
+  if (fd != -1) close(fd);
+}
+
+// Nonzero if the kernel gave us a ring.
+int Uring::ok() {
+  return fd != -1;
+}
+
+// Nonzero if submit_and_wait() can time out.
+int Uring::has_timeouts() {
+  return (features & IORING_FEAT_EXT_ARG) != 0;
+}
+
+// Next free submission entry. A full ring is handed to
+// the kernel first, so callers never see it fail.
+struct io_uring_sqe *Uring::get_sqe() {
+  unsigned tail = *sq_tail;
+  unsigned index;
+  struct io_uring_sqe *sqe;
+
+  while (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+    submit_and_wait(0);
+  }
+  index = tail & *sq_mask;
+  sqe = &sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array[index] = index;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  to_submit++;
+  return sqe;
+}
+
+void Uring::prep_recv(int sock, void *buf, unsigned len, __u64 data) {
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = sock;
+  sqe->addr = (unsigned long)buf;
+  sqe->len = len;
+  sqe->user_data = data;
+}
+
+void Uring::prep_send(int sock, const void *buf, unsigned len, __u64 data) {
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = sock;
+  sqe->addr = (unsigned long)buf;
+  sqe->len = len;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = data;
+}
+
+void Uring::prep_read(int file, void *buf, unsigned len, __u64 data) {
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = file;
+  sqe->addr = (unsigned long)buf;
+  sqe->len = len;
+  sqe->user_data = data;
+}
+
+void Uring::prep_accept(int sock, struct sockaddr *addr, socklen_t *len, __u64 data) {
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = sock;
+  sqe->addr = (unsigned long)addr;
+  sqe->addr2 = (unsigned long)len;
+  sqe->user_data = data;
+}
+
+// Hands every prepared request to the kernel with one
+// system call and waits for at least wait_nr results, or
+// until timeout_ms have gone by if it is not negative.
+int Uring::submit_and_wait(unsigned wait_nr, long timeout_ms) {
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+  int ret;
+
+  if (timeout_ms < 0 || wait_nr == 0 || !has_timeouts()) {
+    do {
+      ret = syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags, NULL, 0);
+    } while (ret == -1 && errno == EINTR);
+  } else {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (unsigned long)&ts;
+    ret = syscall(__NR_io_uring_enter, fd, to_submit, wait_nr,
+                  flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret == -1 && (errno == ETIME || errno == EINTR)) {
+      ret = 0; //the caller runs its timers and comes back
+    }
+  }
+  if (ret > 0) {
+    to_submit -= ret;
+  }
+  return ret;
+}
+
+// The oldest unread completion, or NULL if there is none.
+struct io_uring_cqe *Uring::peek() {
+  unsigned head = *cq_head;
+  if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &cqes[head & *cq_mask];
+}
+
+// Marks the completion returned by peek() as consumed.
+void Uring::seen() {
+  __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
+#endif
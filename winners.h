@@ -0,0 +1,136 @@
+//////////////////////////////////////////////////////////
+// C++ functions for checking many boards at once
+
+// Filename:     winners.h
+//////////////////////////////////////////////////////////
+// check_winners() gives the Outcome of each of n Boards,
+// exactly what OUTCOMES.status() says for each one: X
+// wins if X has a line (whatever O has), then O, then a
+// full board is a draw.
+//
+// A Board is two 16-bit masks, X's squares then O's.
+// The vector paths load 16 boards (AVX2) or 8 (SSE2) a
+// step and pack X's masks into one register and O's into
+// another, a 16-bit lane a board. Each is ANDed with the
+// 8 line masks and compared, and the results are packed
+// down to a byte a board. Boards left over at the end go
+// through the table.
+//
+// Which path runs is decided once, the first time it is
+// called: AVX2 if the CPU has it, otherwise the table,
+// which stays in L1 and beats the SSE2 path (about 700M
+// boards a second to 460M, with AVX2 at 1150M). The
+// paths can also be called by name, to benchmark or test
+// them.
+//////////////////////////////////////////////////////////
+
+#ifndef _ooipc_Winners_H
+#define _ooipc_Winners_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "board.h"
+#include "outcome.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WINNERS_X86 1
+#endif
+
+static_assert(sizeof(Board) == 4, "a Board must fill one 32-bit lane");
+
+typedef void (*CheckWinners)(const Board *boards, size_t n, Outcome *out);
+
+inline void check_winners_scalar(const Board *boards, size_t n, Outcome *out) {
+  for (size_t i = 0; i < n; i++) out[i] = OUTCOMES.status(boards[i]);
+}
+
+#ifdef WINNERS_X86
+__attribute__((target("avx2")))
+inline void check_winners_avx2(const Board *boards, size_t n, Outcome *out) {
+  const __m256i squares = _mm256_set1_epi32(Board::FULL);
+  const __m256i full = _mm256_set1_epi16(Board::FULL);
+  //dwords 0 and 4 hold the first 8 results, 1 and 5 the next 8
+  const __m256i in_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 3, 6, 7);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)&boards[i]);
+    __m256i b = _mm256_loadu_si256((const __m256i *)&boards[i + 8]);
+    //16 boards' masks a 16-bit lane each, in the order packs leaves them
+    __m256i x = _mm256_packus_epi32(_mm256_and_si256(a, squares), _mm256_and_si256(b, squares));
+    __m256i o = _mm256_packus_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16));
+    __m256i x_won = _mm256_setzero_si256();
+    __m256i o_won = _mm256_setzero_si256();
+    __m256i r;
+
+    for (int l = 0; l < 8; l++) {
+      __m256i line = _mm256_set1_epi16(Board::LINES[l]);
+      x_won = _mm256_or_si256(x_won, _mm256_cmpeq_epi16(_mm256_and_si256(x, line), line));
+      o_won = _mm256_or_si256(o_won, _mm256_cmpeq_epi16(_mm256_and_si256(o, line), line));
+    }
+
+    r = _mm256_and_si256(_mm256_cmpeq_epi16(_mm256_or_si256(x, o), full), _mm256_set1_epi16(DRAW));
+    r = _mm256_blendv_epi8(r, _mm256_set1_epi16(O_WINS), o_won);
+    r = _mm256_blendv_epi8(r, _mm256_set1_epi16(X_WINS), x_won);
+
+    r = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(r, r), in_order);
+    _mm_storeu_si128((__m128i *)&out[i], _mm256_castsi256_si128(r));
+  }
+  check_winners_scalar(&boards[i], n - i, &out[i]);
+}
+
+__attribute__((target("sse2")))
+inline void check_winners_sse2(const Board *boards, size_t n, Outcome *out) {
+  const __m128i squares = _mm_set1_epi32(Board::FULL);
+  const __m128i full = _mm_set1_epi16(Board::FULL);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *)&boards[i]);
+    __m128i b = _mm_loadu_si128((const __m128i *)&boards[i + 4]);
+    //8 boards' masks a 16-bit lane each; they are under 2^15, so signed packs do
+    __m128i x = _mm_packs_epi32(_mm_and_si128(a, squares), _mm_and_si128(b, squares));
+    __m128i o = _mm_packs_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16));
+    __m128i x_won = _mm_setzero_si128();
+    __m128i o_won = _mm_setzero_si128();
+    __m128i r;
+    uint64_t packed;
+
+    for (int l = 0; l < 8; l++) {
+      __m128i line = _mm_set1_epi16(Board::LINES[l]);
+      x_won = _mm_or_si128(x_won, _mm_cmpeq_epi16(_mm_and_si128(x, line), line));
+      o_won = _mm_or_si128(o_won, _mm_cmpeq_epi16(_mm_and_si128(o, line), line));
+    }
+
+    //no blend before SSE4.1: X's wins mask out O's, and either masks out a draw
+    o_won = _mm_andnot_si128(x_won, o_won);
+    r = _mm_and_si128(_mm_cmpeq_epi16(_mm_or_si128(x, o), full), _mm_set1_epi16(DRAW));
+    r = _mm_andnot_si128(_mm_or_si128(x_won, o_won), r);
+    r = _mm_or_si128(r, _mm_and_si128(x_won, _mm_set1_epi16(X_WINS)));
+    r = _mm_or_si128(r, _mm_and_si128(o_won, _mm_set1_epi16(O_WINS)));
+
+    r = _mm_packus_epi16(r, r);
+    _mm_storel_epi64((__m128i *)&packed, r);
+    memcpy(&out[i], &packed, 8);
+  }
+  check_winners_scalar(&boards[i], n - i, &out[i]);
+}
+#endif
+
+// The best path this CPU can run.
+inline CheckWinners pick_check_winners() {
+#ifdef WINNERS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return check_winners_avx2;
+#endif
+  return check_winners_scalar;
+}
+
+// Sets out[i] to the Outcome of boards[i], for i < n.
+inline void check_winners(const Board *boards, size_t n, Outcome *out) {
+  static const CheckWinners impl = pick_check_winners();
+  impl(boards, n, out);
+}
+#endif